@@ -3,11 +3,27 @@
 //https://vulkan-tutorial.com/
 //https://learnopengl.com/
 
+#include <cstring>
 #include <iostream>
 
+#include "Model.h"
+#include "ObjLoader.h"
+#include "TransformBatch.h"
 #include "TriangleApp.h"
 
 int main(int argc, char* args[]) {
+    if (argc > 1 && strcmp(args[1], "--bench-transforms") == 0) {
+        svk::benchmarkTransforms(10000, 200);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && strcmp(args[1], "--bench-obj") == 0) {
+        svk::benchmarkObjParsing(argc > 2 ? args[2] : "models/eye/eye.obj", 20);
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && strcmp(args[1], "--bench-dedup") == 0) {
+        svk::benchmarkVertexDedup(argc > 2 ? args[2] : "models/eye/eye.obj", 20);
+        return EXIT_SUCCESS;
+    }
     svk::TriangleApp app{};
     try { app.run(); }
     catch (const std::exception& e) {
@@ -0,0 +1,71 @@
+﻿#include "BindlessTextureTable.h"
+
+#include <cassert>
+#include <stdexcept>
+
+#include "SwapChain.h"
+
+namespace svk {
+    BindlessTextureTable::BindlessTextureTable(Device& dev) : device{dev} {
+        assert(device.supportsBindless() && "Device does not support descriptor indexing");
+
+        // partially bound, empty slots are never read
+        // update unused while pending, new slots can be written while older frames are still executing
+        setLayout = DescriptorSetLayout::Builder(device)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT,
+                Device::MAX_BINDLESS_TEXTURES,
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT)
+            .setLayoutFlags(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT)
+            .build();
+
+        pool = DescriptorPool::Builder(device).setMaxSets(1)
+            .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, Device::MAX_BINDLESS_TEXTURES)
+            .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT).build();
+
+        if (!pool->allocateDescriptor(setLayout->getDescriptorSetLayout(), descriptorSet)) {
+            throw std::runtime_error("failed to allocate bindless texture descriptor set!");
+        }
+
+        textures.resize(Device::MAX_BINDLESS_TEXTURES);
+        freeSlots.reserve(Device::MAX_BINDLESS_TEXTURES);
+        for (uint32_t i = Device::MAX_BINDLESS_TEXTURES; i > 0; i--) { freeSlots.push_back(i - 1); }
+    }
+
+    BindlessTextureTable::~BindlessTextureTable() {}
+
+    uint32_t BindlessTextureTable::getIndex(const std::shared_ptr<Texture>& texture) {
+        auto it = indices.find(texture.get());
+        if (it != indices.end()) { return it->second; }
+
+        if (freeSlots.empty()) { throw std::runtime_error("bindless texture table is full!"); }
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+
+        auto imageInfo = texture->getImageInfo();
+        DescriptorWriter(*setLayout, *pool).writeImage(0, slot, &imageInfo).overwrite(descriptorSet);
+
+        textures[slot] = texture;
+        indices.emplace(texture.get(), slot);
+        return slot;
+    }
+
+    void BindlessTextureTable::collectGarbage() {
+        frameCounter++;
+
+        // only the table holds it, nobody can look it up again so the slot goes into the retire queue
+        for (auto it = indices.begin(); it != indices.end();) {
+            if (textures[it->second].use_count() == 1) {
+                retiredSlots.push_back({frameCounter, it->second, std::move(textures[it->second])});
+                it = indices.erase(it);
+            }
+            else { ++it; }
+        }
+
+        while (!retiredSlots.empty() &&
+            retiredSlots.front().frame + SwapChain::MAX_FRAMES_IN_FLIGHT <= frameCounter) {
+            freeSlots.push_back(retiredSlots.front().slot);
+            retiredSlots.pop_front();
+        }
+    }
+}
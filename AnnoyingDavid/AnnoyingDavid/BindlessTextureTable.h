@@ -0,0 +1,49 @@
+﻿#pragma once
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Descriptors.h"
+#include "Device.h"
+#include "Texture.h"
+
+namespace svk {
+    // One update after bind set holding every texture in a sampler2D array, shaders pick the texture
+    // with an index instead of a per material set. Slots are written once when a texture is first seen.
+    class BindlessTextureTable {
+    public:
+        BindlessTextureTable(Device& dev);
+        ~BindlessTextureTable();
+
+        BindlessTextureTable(const BindlessTextureTable&) = delete;
+        BindlessTextureTable& operator=(const BindlessTextureTable&) = delete;
+
+        // slot of the texture in the array, the table keeps the texture alive while it is in use
+        uint32_t getIndex(const std::shared_ptr<Texture>& texture);
+        // call once per frame, textures nothing else references are dropped and their slot is
+        // reused once every frame in flight that could still sample them has finished
+        void collectGarbage();
+
+        VkDescriptorSetLayout getDescriptorSetLayout() const { return setLayout->getDescriptorSetLayout(); }
+        VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+
+    private:
+        struct RetiredSlot {
+            uint64_t frame;
+            uint32_t slot;
+            std::shared_ptr<Texture> texture;
+        };
+
+        Device& device;
+        std::unique_ptr<DescriptorSetLayout> setLayout;
+        std::unique_ptr<DescriptorPool> pool;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        std::unordered_map<Texture*, uint32_t> indices;
+        std::vector<std::shared_ptr<Texture>> textures; // by slot
+        std::vector<uint32_t> freeSlots;
+        std::deque<RetiredSlot> retiredSlots;
+        uint64_t frameCounter = 0;
+    };
+}
@@ -1,6 +1,8 @@
 ﻿#include "Buffer.h"
 #include <cassert>
 
+#include "Descriptors.h"
+
 /*
  * Encapsulates a vulkan buffer
  * Initially based off VulkanBuffer by Sascha Willems -
@@ -28,22 +30,21 @@ namespace svk {
     }
  
     Buffer::~Buffer() {
+        device.getDescriptorSetCache().forgetBuffer(buffer);
         unmap();
         vkDestroyBuffer(device.getDevice(), buffer, nullptr);
-        vkFreeMemory(device.getDevice(), memory, nullptr);
+        device.getAllocator().free(memory);
     }
 
     VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset) {
-        assert(buffer && memory && "Called map on buffer before create");
-        return vkMapMemory(device.getDevice(), memory, offset, size, 0, &mapped);
+        assert(buffer && memory.memory && "Called map on buffer before create");
+        // host visible blocks are persistently mapped by the allocator
+        if (memory.mapped == nullptr) { return VK_ERROR_MEMORY_MAP_FAILED; }
+        mapped = static_cast<char*>(memory.mapped) + offset;
+        return VK_SUCCESS;
     }
 
-    void Buffer::unmap() {
-        if (mapped) {
-            vkUnmapMemory(device.getDevice(), memory);
-            mapped = nullptr;
-        }
-    }
+    void Buffer::unmap() { mapped = nullptr; }
 
     void Buffer::writeToBuffer(const void *data, VkDeviceSize size, VkDeviceSize offset) {
         assert(mapped && "Cannot copy to unmapped buffer");
@@ -58,21 +59,11 @@ namespace svk {
     }
 
     VkResult Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
-        return vkFlushMappedMemoryRanges(device.getDevice(), 1, &mappedRange);
+        return device.getAllocator().flush(memory, size, offset);
     }
     
     VkResult Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
-        return vkInvalidateMappedMemoryRanges(device.getDevice(), 1, &mappedRange);
+        return device.getAllocator().invalidate(memory, size, offset);
     }
 
     VkDescriptorBufferInfo Buffer::descriptorInfo(VkDeviceSize size, VkDeviceSize offset) {
@@ -39,7 +39,7 @@ namespace svk {
         Device& device;
         void* mapped = nullptr;
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        Allocation memory{};
  
         VkDeviceSize bufferSize;
         uint32_t instanceCount;
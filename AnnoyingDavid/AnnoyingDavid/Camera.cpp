@@ -2,6 +2,48 @@
 
 namespace svk {
 
+    bool Frustum::intersectsSphere(glm::vec3 center, float radius) const {
+        for (auto& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) { return false; }
+        }
+        return true;
+    }
+
+    void Frustum::cullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+                              uint8_t* visible) const {
+        for (size_t i = 0; i < count; i++) { visible[i] = 1; }
+        // plane outer loop keeps the per sphere loop branch free
+        for (auto& plane : planes) {
+            const float a = plane.x;
+            const float b = plane.y;
+            const float c = plane.z;
+            const float d = plane.w;
+            for (size_t i = 0; i < count; i++) {
+                const float distance = a * x[i] + b * y[i] + c * z[i] + d;
+                visible[i] &= static_cast<uint8_t>(distance >= -radius[i]);
+            }
+        }
+    }
+
+    Frustum Camera::getFrustum() const {
+        // Gribb/Hartmann, planes are sums of the rows of projection * view, depth is 0..1
+        const glm::mat4 m = projectionMatrix * viewMatrix;
+        const glm::vec4 row0{m[0][0], m[1][0], m[2][0], m[3][0]};
+        const glm::vec4 row1{m[0][1], m[1][1], m[2][1], m[3][1]};
+        const glm::vec4 row2{m[0][2], m[1][2], m[2][2], m[3][2]};
+        const glm::vec4 row3{m[0][3], m[1][3], m[2][3], m[3][3]};
+
+        Frustum frustum{};
+        frustum.planes[0] = row3 + row0; // left
+        frustum.planes[1] = row3 - row0; // right
+        frustum.planes[2] = row3 + row1; // top, y points down
+        frustum.planes[3] = row3 - row1; // bottom
+        frustum.planes[4] = row2; // near
+        frustum.planes[5] = row3 - row2; // far
+        for (auto& plane : frustum.planes) { plane /= glm::length(glm::vec3(plane)); }
+        return frustum;
+    }
+
     void Camera::setOrthographicProjection(float left, float right, float top, float bottom, float near, float far) {
          projectionMatrix = glm::mat4{1.0f};
          projectionMatrix[0][0] = 2.f / (right - left);
@@ -10,6 +52,8 @@ namespace svk {
          projectionMatrix[3][0] = -(right + left) / (right - left);
          projectionMatrix[3][1] = -(bottom + top) / (bottom - top);
          projectionMatrix[3][2] = -near / (far - near);
+         nearPlane = near;
+         farPlane = far;
     }
     
     void Camera::setPerspectiveProjection(float fovy, float aspect, float near, float far) {
@@ -21,6 +65,8 @@ namespace svk {
         projectionMatrix[2][2] = far / (far - near);
         projectionMatrix[2][3] = 1.f;
         projectionMatrix[3][2] = -(far * near) / (far - near);
+        nearPlane = near;
+        farPlane = far;
     }
     
     void Camera::setViewDirection(glm::vec3 position, glm::vec3 direction, glm::vec3 up) {
@@ -4,7 +4,20 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <cstddef>
+#include <cstdint>
+
 namespace svk {
+    // world space planes facing inwards, a point is inside when dot(plane.xyz, p) + plane.w >= 0
+    struct Frustum {
+        glm::vec4 planes[6];
+
+        bool intersectsSphere(glm::vec3 center, float radius) const;
+        // structure of arrays so the inner loop vectorizes, visible[i] is 1 when sphere i is at least partly inside
+        void cullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t count,
+            uint8_t* visible) const;
+    };
+
     class Camera {
     public:
         void setOrthographicProjection(float left, float right, float top, float bottom, float near, float far);
@@ -19,10 +32,15 @@ namespace svk {
         const glm::mat4& getView() const { return viewMatrix; }
         const glm::mat4& getInverseView() const { return inverseViewMatrix; }
         const glm::vec3 getPosition() const { return glm::vec3(inverseViewMatrix[3]); }
+        float getNear() const { return nearPlane; }
+        float getFar() const { return farPlane; }
+        Frustum getFrustum() const;
 
     private:
         glm::mat4 projectionMatrix{1.f};
         glm::mat4 viewMatrix{1.f};
         glm::mat4 inverseViewMatrix{1.f};
+        float nearPlane = 0.1f;
+        float farPlane = 100.0f;
     };
 }
\ No newline at end of file
@@ -1,15 +1,87 @@
 ﻿#include "Descriptors.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <stdexcept>
 
 #include "Device.h"
+#include "Utils.h"
 
 namespace svk {
+    template <typename T>
+    static uint64_t handleBits(T handle) { return (uint64_t)handle; }
+
+    size_t DescriptorKeyHash::operator()(const DescriptorKey& key) const {
+        size_t seed = key.size();
+        for (auto word : key) { hashCombine(seed, word); }
+        return seed;
+    }
+
+    // *************** Descriptor Layout Cache *********************
+
+    DescriptorLayoutCache::~DescriptorLayoutCache() {
+        for (auto& kv : layouts) { vkDestroyDescriptorSetLayout(device.getDevice(), kv.second.layout, nullptr); }
+    }
+
+    VkDescriptorSetLayout DescriptorLayoutCache::acquire(const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+        const std::vector<VkDescriptorBindingFlags>& bindingFlags, VkDescriptorSetLayoutCreateFlags layoutFlags) {
+        DescriptorKey key{layoutFlags};
+        for (size_t i = 0; i < bindings.size(); i++) {
+            auto& binding = bindings[i];
+            assert(binding.pImmutableSamplers == nullptr && "Immutable samplers are not part of the cache key");
+            key.push_back(binding.binding);
+            key.push_back(binding.descriptorType);
+            key.push_back(binding.descriptorCount);
+            key.push_back(binding.stageFlags);
+            key.push_back(bindingFlags[i]);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = layouts.find(key);
+        if (it != layouts.end()) {
+            it->second.users++;
+            return it->second.layout;
+        }
+
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+        descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        descriptorSetLayoutInfo.pBindings = bindings.data();
+        descriptorSetLayoutInfo.flags = layoutFlags;
+
+        // flags array has to line up with pBindings
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+        bool anyFlags = std::any_of(bindingFlags.begin(), bindingFlags.end(), [](auto flags) { return flags != 0; });
+        if (anyFlags) { descriptorSetLayoutInfo.pNext = &bindingFlagsInfo; }
+
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(device.getDevice(), &descriptorSetLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+        layouts.emplace(std::move(key), Entry{layout, 1});
+        return layout;
+    }
+
+    void DescriptorLayoutCache::release(VkDescriptorSetLayout layout) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find_if(layouts.begin(), layouts.end(),
+            [layout](const auto& kv) { return kv.second.layout == layout; });
+        assert(it != layouts.end() && "Layout was not created by this cache");
+        if (--it->second.users == 0) {
+            vkDestroyDescriptorSetLayout(device.getDevice(), layout, nullptr);
+            layouts.erase(it);
+        }
+    }
+
     // *************** Descriptor Set Layout Builder *********************
 
     DescriptorSetLayout::Builder& DescriptorSetLayout::Builder::addBinding(uint32_t binding,
-        VkDescriptorType descriptorType, VkShaderStageFlags stageFlags, uint32_t count) {
+        VkDescriptorType descriptorType, VkShaderStageFlags stageFlags, uint32_t count,
+        VkDescriptorBindingFlags flags) {
         assert(bindings.count(binding) == 0 && "Binding already in use");
 
         VkDescriptorSetLayoutBinding layoutBinding{};
@@ -18,35 +90,42 @@ namespace svk {
         layoutBinding.descriptorCount = count;
         layoutBinding.stageFlags = stageFlags;
         bindings[binding] = layoutBinding;
+        if (flags != 0) { bindingFlags[binding] = flags; }
+        return *this;
+    }
+
+    DescriptorSetLayout::Builder& DescriptorSetLayout::Builder::setLayoutFlags(
+        VkDescriptorSetLayoutCreateFlags flags) {
+        layoutFlags = flags;
         return *this;
     }
 
     std::unique_ptr<DescriptorSetLayout> DescriptorSetLayout::Builder::build() const {
-        return std::make_unique<DescriptorSetLayout>(device, bindings);
+        return std::make_unique<DescriptorSetLayout>(device, bindings, bindingFlags, layoutFlags);
     }
 
     // *************** Descriptor Set Layout *********************
 
-    DescriptorSetLayout::DescriptorSetLayout(Device& dev, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> binds)
+    DescriptorSetLayout::DescriptorSetLayout(Device& dev, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> binds,
+        const std::unordered_map<uint32_t, VkDescriptorBindingFlags>& bindingFlags,
+        VkDescriptorSetLayoutCreateFlags layoutFlags)
         : device{dev}, bindings{binds} {
+        // sorted, so the same bindings added in any order map to one cached layout
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
-        for (auto kv : binds) {
-            setLayoutBindings.push_back(kv.second);
-        }
-
-        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
-        descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-        descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
-
-        if (vkCreateDescriptorSetLayout(device.getDevice(), &descriptorSetLayoutInfo,
-            nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor set layout!");
+        for (auto& kv : binds) { setLayoutBindings.push_back(kv.second); }
+        std::sort(setLayoutBindings.begin(), setLayoutBindings.end(),
+            [](const auto& a, const auto& b) { return a.binding < b.binding; });
+
+        std::vector<VkDescriptorBindingFlags> setLayoutBindingFlags{};
+        for (auto& binding : setLayoutBindings) {
+            auto flags = bindingFlags.find(binding.binding);
+            setLayoutBindingFlags.push_back(flags != bindingFlags.end() ? flags->second : 0);
         }
+        descriptorSetLayout = device.getLayoutCache().acquire(setLayoutBindings, setLayoutBindingFlags, layoutFlags);
     }
 
     DescriptorSetLayout::~DescriptorSetLayout() {
-        vkDestroyDescriptorSetLayout(device.getDevice(), descriptorSetLayout, nullptr);
+        device.getLayoutCache().release(descriptorSetLayout);
     }
 
     // *************** Descriptor Pool Builder *********************
@@ -100,8 +179,8 @@ namespace svk {
         allocInfo.pSetLayouts = &descriptorSetLayout;
         allocInfo.descriptorSetCount = 1;
 
-        // Might want to create a "DescriptorPoolManager" class that handles this case, and builds
-        // a new pool whenever an old pool fills up. But this is beyond our current scope
+        // a fixed size pool just fails once it is full, sets that grow with the scene go through the
+        // DescriptorSetCache, which chains a new pool instead
         if (vkAllocateDescriptorSets(device.getDevice(), &allocInfo, &descriptor) != VK_SUCCESS) {
             return false;
         }
@@ -120,10 +199,140 @@ namespace svk {
         vkResetDescriptorPool(device.getDevice(), descriptorPool, 0);
     }
 
+    // *************** Descriptor Set Cache *********************
+
+    bool DescriptorSetCache::getOrCreate(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes,
+        VkDescriptorSet& set) {
+        DescriptorKey key{handleBits(layout)};
+        std::vector<uint64_t> resources;
+        for (auto& write : writes) {
+            key.push_back(write.dstBinding);
+            key.push_back(write.dstArrayElement);
+            key.push_back(write.descriptorType);
+            for (uint32_t i = 0; i < write.descriptorCount; i++) {
+                if (write.pBufferInfo != nullptr) {
+                    auto& info = write.pBufferInfo[i];
+                    key.push_back(handleBits(info.buffer));
+                    key.push_back(info.offset);
+                    key.push_back(info.range);
+                    resources.push_back(handleBits(info.buffer));
+                }
+                else if (write.pImageInfo != nullptr) {
+                    auto& info = write.pImageInfo[i];
+                    key.push_back(handleBits(info.imageView));
+                    key.push_back(handleBits(info.sampler));
+                    key.push_back(info.imageLayout);
+                    resources.push_back(handleBits(info.imageView));
+                    resources.push_back(handleBits(info.sampler));
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sets.find(key);
+        if (it != sets.end()) {
+            it->second.lastUsedFrame = frame;
+            hits++;
+            set = it->second.set;
+            return true;
+        }
+        misses++;
+
+        // newest pool first, older ones only get room back through evictions
+        Entry entry{VK_NULL_HANDLE, nullptr, frame, std::move(resources)};
+        for (auto pool = pools.rbegin(); pool != pools.rend(); ++pool) {
+            if ((*pool)->allocateDescriptor(layout, entry.set)) {
+                entry.pool = pool->get();
+                break;
+            }
+        }
+        if (entry.pool == nullptr) {
+            pools.push_back(DescriptorPool::Builder(device)
+                .setMaxSets(SETS_PER_POOL)
+                .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SETS_PER_POOL)
+                .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * SETS_PER_POOL)
+                .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * SETS_PER_POOL)
+                .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
+                .build());
+            if (!pools.back()->allocateDescriptor(layout, entry.set)) {
+                return false;
+            }
+            entry.pool = pools.back().get();
+        }
+
+        allocations++;
+
+        std::vector<VkWriteDescriptorSet> setWrites = writes;
+        for (auto& write : setWrites) { write.dstSet = entry.set; }
+        vkUpdateDescriptorSets(device.getDevice(), static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0,
+            nullptr);
+        set = entry.set;
+        sets.emplace(std::move(key), std::move(entry));
+        return true;
+    }
+
+    void DescriptorSetCache::nextFrame() {
+        std::lock_guard<std::mutex> lock(mutex);
+        frame++;
+        for (auto it = sets.begin(); it != sets.end();) {
+            if (it->second.lastUsedFrame + EVICT_AFTER_FRAMES < frame) {
+                release(it->second);
+                it = sets.erase(it);
+            }
+            else { ++it; }
+        }
+    }
+
+    DescriptorSetCache::Stats DescriptorSetCache::getStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats stats{};
+        stats.poolCount = static_cast<uint32_t>(pools.size());
+        stats.liveSets = static_cast<uint32_t>(sets.size());
+        stats.allocations = allocations;
+        stats.hits = hits;
+        stats.misses = misses;
+        return stats;
+    }
+
+    void DescriptorSetCache::printStats() {
+        auto stats = getStats();
+        printf("descriptor set cache: %u sets in %u pools, %llu allocations, %llu hits, %llu misses\n",
+               stats.liveSets, stats.poolCount, static_cast<unsigned long long>(stats.allocations),
+               static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses));
+    }
+
+    void DescriptorSetCache::forgetBuffer(VkBuffer buffer) { forget(handleBits(buffer)); }
+
+    void DescriptorSetCache::forgetImage(VkImageView imageView, VkSampler sampler) {
+        forget(handleBits(imageView));
+        forget(handleBits(sampler));
+    }
+
+    void DescriptorSetCache::forget(uint64_t resource) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = sets.begin(); it != sets.end();) {
+            auto& resources = it->second.resources;
+            if (std::find(resources.begin(), resources.end(), resource) != resources.end()) {
+                release(it->second);
+                it = sets.erase(it);
+            }
+            else { ++it; }
+        }
+    }
+
+    void DescriptorSetCache::release(const Entry& entry) {
+        std::vector<VkDescriptorSet> descriptors{entry.set};
+        entry.pool->freeDescriptors(descriptors);
+    }
+
     // *************** Descriptor Writer *********************
 
     DescriptorWriter::DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorPool& pool)
-        : setLayout{setLayout}, pool{pool} {
+        : setLayout{setLayout}, pool{&pool} {
+    }
+
+    DescriptorWriter::DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorSetCache& setCache)
+        : setLayout{setLayout}, setCache{&setCache} {
     }
 
     DescriptorWriter& DescriptorWriter::writeBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo) {
@@ -162,9 +371,31 @@ namespace svk {
         return *this;
     }
 
+    DescriptorWriter& DescriptorWriter::writeImage(uint32_t binding, uint32_t arrayElement,
+        VkDescriptorImageInfo* imageInfo) {
+        assert(setLayout.bindings.count(binding) == 1 && "Layout does not contain specified binding");
+
+        auto& bindingDescription = setLayout.bindings[binding];
+
+        assert(arrayElement < bindingDescription.descriptorCount && "Array element out of range for binding");
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.descriptorType = bindingDescription.descriptorType;
+        write.dstBinding = binding;
+        write.dstArrayElement = arrayElement;
+        write.pImageInfo = imageInfo;
+        write.descriptorCount = 1;
+
+        writes.push_back(write);
+        return *this;
+    }
+
     bool DescriptorWriter::build(VkDescriptorSet& set) {
-        bool success = pool.allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
-        if (!success) {
+        if (setCache != nullptr) {
+            return setCache->getOrCreate(setLayout.getDescriptorSetLayout(), writes, set);
+        }
+        if (!pool->allocateDescriptor(setLayout.getDescriptorSetLayout(), set)) {
             return false;
         }
         overwrite(set);
@@ -175,7 +406,7 @@ namespace svk {
         for (auto& write : writes) {
             write.dstSet = set;
         }
-        vkUpdateDescriptorSets(pool.device.getDevice(), writes.size(), writes.data(), 0, nullptr);
+        vkUpdateDescriptorSets(setLayout.device.getDevice(), writes.size(), writes.data(), 0, nullptr);
     }
 
 }
@@ -1,10 +1,44 @@
 ﻿#pragma once
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "Device.h"
 
 namespace svk {
+    // layouts and sets are cached under their contents packed into 64 bit words
+    using DescriptorKey = std::vector<uint64_t>;
+
+    struct DescriptorKeyHash {
+        size_t operator()(const DescriptorKey& key) const;
+    };
+
+    // One VkDescriptorSetLayout per distinct set of bindings, owned by the Device. Identical layouts
+    // built by different systems share the handle, it is destroyed together with its last user.
+    class DescriptorLayoutCache {
+    public:
+        DescriptorLayoutCache(Device& dev) : device{dev} {}
+        ~DescriptorLayoutCache();
+        DescriptorLayoutCache(const DescriptorLayoutCache&) = delete;
+        DescriptorLayoutCache& operator=(const DescriptorLayoutCache&) = delete;
+
+        // bindings sorted by binding number, flags line up with them
+        VkDescriptorSetLayout acquire(const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+            const std::vector<VkDescriptorBindingFlags>& bindingFlags, VkDescriptorSetLayoutCreateFlags layoutFlags);
+        void release(VkDescriptorSetLayout layout);
+
+    private:
+        struct Entry {
+            VkDescriptorSetLayout layout;
+            uint32_t users;
+        };
+
+        Device& device;
+        std::mutex mutex;
+        std::unordered_map<DescriptorKey, Entry, DescriptorKeyHash> layouts;
+    };
+
     class DescriptorSetLayout {
     public:
         class Builder {
@@ -12,14 +46,19 @@ namespace svk {
             Builder(Device& dev) : device{dev} {}
             
             Builder& addBinding(uint32_t binding, VkDescriptorType descriptorType,
-                VkShaderStageFlags stageFlags, uint32_t count = 1);
+                VkShaderStageFlags stageFlags, uint32_t count = 1, VkDescriptorBindingFlags bindingFlags = 0);
+            Builder& setLayoutFlags(VkDescriptorSetLayoutCreateFlags flags);
             std::unique_ptr<DescriptorSetLayout> build() const;
         private:
             Device& device;
             std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings{};
+            std::unordered_map<uint32_t, VkDescriptorBindingFlags> bindingFlags{};
+            VkDescriptorSetLayoutCreateFlags layoutFlags = 0;
         };
 
-        DescriptorSetLayout(Device& dev, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> binds);
+        DescriptorSetLayout(Device& dev, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> binds,
+            const std::unordered_map<uint32_t, VkDescriptorBindingFlags>& bindingFlags = {},
+            VkDescriptorSetLayoutCreateFlags layoutFlags = 0);
         ~DescriptorSetLayout();
         DescriptorSetLayout(const DescriptorSetLayout&) = delete;
         DescriptorSetLayout& operator=(const DescriptorSetLayout&) = delete;
@@ -69,18 +108,79 @@ namespace svk {
         friend class DescriptorWriter;
     };
 
+    // Sets keyed by their layout and every buffer and image written into them, owned by the Device.
+    // Identical bindings, across objects and frames, get the same set back without allocating or writing.
+    // Cached sets are never written again. Sets unused for EVICT_AFTER_FRAMES frames are freed, sets
+    // referencing a destroyed buffer, view or sampler right away so a recycled handle can not alias them.
+    // Pools are chained, a new one is added whenever every existing pool is full, so the number of sets is
+    // not capped by a pool size. Freed sets go back to their pool and are reused by later allocations.
+    class DescriptorSetCache {
+    public:
+        static constexpr uint64_t EVICT_AFTER_FRAMES = 120;
+        static constexpr uint32_t SETS_PER_POOL = 256;
+
+        struct Stats {
+            uint32_t poolCount = 0;
+            uint32_t liveSets = 0; // currently cached
+            uint64_t allocations = 0; // vkAllocateDescriptorSets calls since startup
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+        };
+
+        DescriptorSetCache(Device& dev) : device{dev} {}
+        DescriptorSetCache(const DescriptorSetCache&) = delete;
+        DescriptorSetCache& operator=(const DescriptorSetCache&) = delete;
+
+        bool getOrCreate(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes,
+            VkDescriptorSet& set);
+        // call once per frame after its fence has signaled
+        void nextFrame();
+        void forgetBuffer(VkBuffer buffer);
+        void forgetImage(VkImageView imageView, VkSampler sampler);
+
+        uint64_t getHits() const { return hits; }
+        uint64_t getMisses() const { return misses; }
+        Stats getStats();
+        void printStats();
+
+    private:
+        struct Entry {
+            VkDescriptorSet set;
+            DescriptorPool* pool;
+            uint64_t lastUsedFrame;
+            std::vector<uint64_t> resources;
+        };
+
+        void forget(uint64_t resource);
+        void release(const Entry& entry);
+
+        Device& device;
+        std::mutex mutex;
+        std::unordered_map<DescriptorKey, Entry, DescriptorKeyHash> sets;
+        std::vector<std::unique_ptr<DescriptorPool>> pools;
+        uint64_t frame = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t allocations = 0;
+    };
+
     class DescriptorWriter {
     public:
         DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorPool& pool);
+        // build() returns a cached set when one with the same writes exists, never use overwrite() on it
+        DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorSetCache& setCache);
 
         DescriptorWriter& writeBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
         DescriptorWriter& writeImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);
+        // single element of an array binding
+        DescriptorWriter& writeImage(uint32_t binding, uint32_t arrayElement, VkDescriptorImageInfo* imageInfo);
 
         bool build(VkDescriptorSet& set);
         void overwrite(VkDescriptorSet& set);
     private:
         DescriptorSetLayout& setLayout;
-        DescriptorPool& pool;
+        DescriptorPool* pool = nullptr;
+        DescriptorSetCache* setCache = nullptr;
         std::vector<VkWriteDescriptorSet> writes;
     };
 }
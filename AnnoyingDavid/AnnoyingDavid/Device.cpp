@@ -1,8 +1,14 @@
 ﻿#include "Device.h"
+#include "Descriptors.h"
 
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <set>
 #include <stdexcept>
 
+#include "Utils.h"
+
 namespace svk {
     VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
                                                  VkDebugUtilsMessageTypeFlagsEXT message_type,
@@ -49,6 +55,22 @@ namespace svk {
         if (func != nullptr) { func(instance, debugMessenger, pAllocator); }
     }
 
+    // written in front of the driver blob. the vulkan header has no driver version and no checksum,
+    // a blob from an updated driver or a truncated write would otherwise reach the driver as is
+    struct PipelineCacheFileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505653; // "SVPC"
+    static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
     Device::Device(Window& win) : window{(&win)} {
         createInstance();
         setupDebugMessenger();
@@ -56,9 +78,20 @@ namespace svk {
         pickPhysicalDevice();
         createLogicalDevice();
         createCommandPool();
+        createPipelineCache();
+        allocator = std::make_unique<MemoryAllocator>(device, physicalDevice);
+        uploader = std::make_unique<UploadManager>(*this);
+        layoutCache = std::make_unique<DescriptorLayoutCache>(*this);
+        setCache = std::make_unique<DescriptorSetCache>(*this);
     }
 
     Device::~Device() {
+        setCache.reset();
+        layoutCache.reset();
+        uploader.reset();
+        allocator.reset();
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, nullptr);
         vkDestroyCommandPool(device, commandPool, nullptr);
         vkDestroyDevice(device, nullptr);
         if (enableValidationLayers) { DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr); }
@@ -73,7 +106,8 @@ namespace svk {
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        // 1.2 for descriptor indexing, pickPhysicalDevice checks what the gpu actually supports
+        appInfo.apiVersion = VK_API_VERSION_1_2;
 
         VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
         debugCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -134,13 +168,51 @@ namespace svk {
         }
 
         if (physicalDevice == nullptr) throw std::runtime_error("failed to find a suitable GPU!");
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        drawIndirectFirstInstanceSupported = supportedFeatures.drawIndirectFirstInstance;
+
+        if (properties.apiVersion >= VK_API_VERSION_1_2) {
+            VkPhysicalDeviceVulkan12Features supported12{};
+            supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            VkPhysicalDeviceFeatures2 features2{};
+            features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+            features2.pNext = &supported12;
+            vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+            VkPhysicalDeviceVulkan12Properties properties12{};
+            properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &properties12;
+            vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+            // only what the bindless texture table needs
+            bindlessSupported = supported12.shaderSampledImageArrayNonUniformIndexing &&
+                supported12.descriptorBindingSampledImageUpdateAfterBind &&
+                supported12.descriptorBindingPartiallyBound &&
+                supported12.descriptorBindingUpdateUnusedWhilePending &&
+                properties12.maxDescriptorSetUpdateAfterBindSampledImages >= MAX_BINDLESS_TEXTURES &&
+                properties12.maxPerStageDescriptorUpdateAfterBindSamplers >= MAX_BINDLESS_TEXTURES;
+            if (bindlessSupported) {
+                enabledFeatures12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+                enabledFeatures12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+                enabledFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+                enabledFeatures12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+            }
+            drawIndirectCountSupported = supported12.drawIndirectCount;
+            enabledFeatures12.drawIndirectCount = supported12.drawIndirectCount;
+        }
     }
 
     void Device::createLogicalDevice() {
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+        std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(),
+            indices.transferFamily.value()};
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) {
             VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -155,12 +227,14 @@ namespace svk {
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;
         deviceFeatures.sampleRateShading = VK_TRUE; // enable sample shading feature for the device
+        deviceFeatures.drawIndirectFirstInstance = drawIndirectFirstInstanceSupported;
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
         createInfo.pEnabledFeatures = &deviceFeatures;
+        if (properties.apiVersion >= VK_API_VERSION_1_2) { createInfo.pNext = &enabledFeatures12; }
         createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
         createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
@@ -175,6 +249,7 @@ namespace svk {
         }
         vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
     }
 
     void Device::createCommandPool() {
@@ -190,6 +265,120 @@ namespace svk {
         }
     }
 
+    void Device::createPipelineCache() {
+        std::vector<char> initialData = loadPipelineCacheData();
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = initialData.size();
+        cacheInfo.pInitialData = initialData.data();
+
+        VkResult result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+        if (result != VK_SUCCESS && !initialData.empty()) {
+            // a blob the driver still refuses only costs the warm start
+            printf("pipeline cache: rejected by the driver, starting cold\n");
+            initialData.clear();
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = nullptr;
+            result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+        }
+        if (result != VK_SUCCESS) { throw std::runtime_error("failed to create pipeline cache!"); }
+        pipelineCacheWarm = !initialData.empty();
+    }
+
+    std::vector<char> Device::loadPipelineCacheData() {
+        std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) { return {}; }
+        size_t fileSize = file.tellg();
+        file.seekg(0);
+
+        auto reject = [](const char* reason) {
+            printf("pipeline cache: %s, starting cold\n", reason);
+            return std::vector<char>{};
+        };
+
+        PipelineCacheFileHeader header{};
+        if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return reject("file too small");
+        }
+        if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION) {
+            return reject("unknown file format");
+        }
+        if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+            header.driverVersion != properties.driverVersion ||
+            std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            return reject("written by another device or driver");
+        }
+        if (header.dataSize != fileSize - sizeof(header)) { return reject("truncated file"); }
+
+        std::vector<char> data(header.dataSize);
+        if (!file.read(data.data(), data.size()) || fnv1a(data.data(), data.size()) != header.dataHash) {
+            return reject("checksum mismatch");
+        }
+
+        // the driver checks its own header too, but not every driver is careful about it
+        VkPipelineCacheHeaderVersionOne driverHeader{};
+        if (data.size() < sizeof(driverHeader)) { return reject("driver header missing"); }
+        std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+        if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            driverHeader.vendorID != properties.vendorID || driverHeader.deviceID != properties.deviceID ||
+            std::memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            return reject("driver header mismatch");
+        }
+        return data;
+    }
+
+    void Device::savePipelineCache() {
+        // runs from the destructor, a cache that cannot be written is only reported
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+            return;
+        }
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+            printf("pipeline cache: failed to read back the cache data\n");
+            return;
+        }
+        data.resize(dataSize);
+
+        PipelineCacheFileHeader header{};
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.version = PIPELINE_CACHE_VERSION;
+        header.vendorID = properties.vendorID;
+        header.deviceID = properties.deviceID;
+        header.driverVersion = properties.driverVersion;
+        std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.dataSize = data.size();
+        header.dataHash = fnv1a(data.data(), data.size());
+
+        // written next to the old file and swapped in, a crash mid write never leaves a torn cache behind
+        std::string tempPath = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), data.size());
+            if (!file) {
+                printf("pipeline cache: failed to write %s\n", tempPath.c_str());
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+        if (error) { printf("pipeline cache: failed to replace %s\n", PIPELINE_CACHE_PATH); }
+    }
+
+    void Device::recordPipelineCreation(double milliseconds) {
+        std::lock_guard<std::mutex> lock(pipelineStatsMutex);
+        pipelineCount++;
+        pipelineMilliseconds += milliseconds;
+    }
+
+    void Device::printPipelineStats() {
+        std::lock_guard<std::mutex> lock(pipelineStatsMutex);
+        printf("pipelines: %u created in %.2f ms, %s cache\n", pipelineCount, pipelineMilliseconds,
+               pipelineCacheWarm ? "warm" : "cold");
+    }
+
     void Device::createSurface() { window->createWindowSurface(instance, surface); }
 
     bool Device::isDeviceSuitable(VkPhysicalDevice device) {
@@ -292,6 +481,22 @@ namespace svk {
             if (indices.isComplete()) { break; }
             i++;
         }
+
+        // transfer queue, a transfer only family (dma engine) beats one without graphics, else share graphics
+        int bestScore = -1;
+        for (uint32_t j = 0; j < queueFamilyCount; j++) {
+            VkQueueFlags flags = queueFamilies[j].queueFlags;
+            // graphics and compute families support transfers even when the bit is not reported
+            if (!(flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) { continue; }
+            int score = 0;
+            if (!(flags & VK_QUEUE_GRAPHICS_BIT)) { score = 1; }
+            if (!(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) { score = 2; }
+            if (score > bestScore && (score > 0 || j == indices.graphicsFamily)) {
+                bestScore = score;
+                indices.transferFamily = j;
+            }
+        }
+        if (!indices.transferFamily.has_value()) { indices.transferFamily = indices.graphicsFamily; }
         return indices;
     }
 
@@ -334,19 +539,11 @@ namespace svk {
     }
 
     uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-        throw std::runtime_error("failed to find suitable memory type!");
+        return allocator->findMemoryType(typeFilter, properties);
     }
 
     void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-                              VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+                              VkBuffer& buffer, Allocation& bufferMemory) {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = size;
@@ -359,15 +556,10 @@ namespace svk {
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
+        bufferMemory = allocator->allocate(memRequirements, properties, true);
+        if (vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind buffer memory!");
         }
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);
     }
     
     VkCommandBuffer Device::beginSingleTimeCommands() {
@@ -431,7 +623,7 @@ namespace svk {
     }
 
     void Device::createImageWithInfo(const VkImageCreateInfo& imageInfo,
-                                     VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+                                     VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageMemory) {
         if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image!");
         }
@@ -439,16 +631,8 @@ namespace svk {
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
-
-        if (vkBindImageMemory(device, image, imageMemory, 0) != VK_SUCCESS) {
+        imageMemory = allocator->allocate(memRequirements, properties, imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
+        if (vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS) {
             throw std::runtime_error("failed to bind image memory!");
         }
     }
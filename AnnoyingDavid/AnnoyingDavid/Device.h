@@ -1,7 +1,11 @@
 ﻿#pragma once
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
 #include "Window.h"
 
 namespace svk
@@ -17,9 +21,14 @@ namespace svk
     {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        std::optional<uint32_t> transferFamily; // falls back to the graphics family when there is no better one
         bool isComplete() { return graphicsFamily.has_value() && presentFamily.has_value(); }
+        bool hasDedicatedTransfer() const { return transferFamily != graphicsFamily; }
     };
     
+    class DescriptorLayoutCache;
+    class DescriptorSetCache;
+
     class Device
     {
     #ifdef NDEBUG
@@ -29,6 +38,11 @@ namespace svk
     #endif
         
     public:
+        // size of the bindless texture array, devices that cannot hold this many fall back to per texture sets
+        static constexpr uint32_t MAX_BINDLESS_TEXTURES = 1024;
+        // loaded on startup and written back on shutdown, relative to the working directory like the shaders
+        static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
         Device(Window &win);
         ~Device();
         
@@ -42,6 +56,18 @@ namespace svk
         VkSurfaceKHR getSurface() { return surface; }
         VkQueue GetGraphicsQueue() { return graphicsQueue; }
         VkQueue GetPresentQueue() { return presentQueue; }
+        VkQueue GetTransferQueue() { return transferQueue; }
+        MemoryAllocator& getAllocator() { return *allocator; }
+        UploadManager& getUploader() { return *uploader; }
+        DescriptorLayoutCache& getLayoutCache() { return *layoutCache; }
+        DescriptorSetCache& getDescriptorSetCache() { return *setCache; }
+        VkPipelineCache getPipelineCache() { return pipelineCache; }
+        // the cache started from a valid file on disk
+        bool isPipelineCacheWarm() const { return pipelineCacheWarm; }
+
+        // pipelines report their creation time, so cold and warm starts can be compared
+        void recordPipelineCreation(double milliseconds);
+        void printPipelineStats();
 
         SwapChainSupportDetails getSwapChainSupport()
         { return querySwapChainSupport(physicalDevice); }
@@ -53,19 +79,23 @@ namespace svk
             VkImageTiling tiling, VkFormatFeatureFlags features);
 
         void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-            VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+            VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory);
         VkCommandBuffer beginSingleTimeCommands();
         void endSingleTimeCommands(VkCommandBuffer commandBuffer);
         void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
         void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
         void createImageWithInfo( const VkImageCreateInfo &imageInfo,
-        VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory);
+        VkMemoryPropertyFlags properties, VkImage &image, Allocation &imageMemory);
 
         void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout,
         uint32_t mipLevels = 1, uint32_t layerCount = 1);
 
         VkPhysicalDeviceProperties properties{};
+        bool supportsBindless() const { return bindlessSupported; }
+        // culled instances are placed with the indirect command's firstInstance
+        bool supportsGpuCulling() const { return drawIndirectFirstInstanceSupported; }
+        bool supportsDrawIndirectCount() const { return drawIndirectCountSupported; }
         
     private:
         void createInstance();
@@ -74,6 +104,9 @@ namespace svk
         void pickPhysicalDevice();
         void createLogicalDevice();
         void createCommandPool();
+        void createPipelineCache();
+        void savePipelineCache();
+        std::vector<char> loadPipelineCacheData();
 
         bool isDeviceSuitable(VkPhysicalDevice device);
         std::vector<const char*> getRequiredExtensions() const;
@@ -89,11 +122,25 @@ namespace svk
         VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
         Window* window{};
         VkCommandPool commandPool = nullptr;
+        std::unique_ptr<MemoryAllocator> allocator;
+        std::unique_ptr<UploadManager> uploader;
+        std::unique_ptr<DescriptorLayoutCache> layoutCache;
+        std::unique_ptr<DescriptorSetCache> setCache;
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+        bool pipelineCacheWarm = false;
+        std::mutex pipelineStatsMutex;
+        uint32_t pipelineCount = 0;
+        double pipelineMilliseconds = 0.0;
+        VkPhysicalDeviceVulkan12Features enabledFeatures12{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+        bool bindlessSupported = false;
+        VkBool32 drawIndirectFirstInstanceSupported = VK_FALSE;
+        VkBool32 drawIndirectCountSupported = VK_FALSE;
 
         VkSurfaceKHR surface = VK_NULL_HANDLE;
         VkDevice device = VK_NULL_HANDLE;
         VkQueue graphicsQueue = nullptr;
  	    VkQueue presentQueue = nullptr;
+        VkQueue transferQueue = nullptr;
 
         const std::vector<const char*> validationLayers = { "VK_LAYER_KHRONOS_validation" };
         const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
@@ -2,11 +2,13 @@
 #include "Camera.h"
 #include "Descriptors.h"
 #include "GameObj.h"
+#include "JobSystem.h"
 
 namespace svk {
+    // one entry of the light storage buffer
     struct PointLight {
-        glm::vec4 position{};
-        glm::vec4 color{};
+        glm::vec4 position{}; // w is the radius past which the light is ignored
+        glm::vec4 color{}; // w is the intensity
     };
     
     struct GlobalUbo {
@@ -14,8 +16,8 @@ namespace svk {
         glm::mat4 view{1.0f};
         glm::mat4 inverseView{1.0f};
         alignas(16) glm::vec4 lightColor{1.0f, 0.9f, 0.6f, 0.1f};
-        PointLight pointLights[10];
-        int numbLights;
+        glm::vec4 clusterParams{}; // screen size in xy, depth slice scale and bias in zw
+        glm::uvec4 clusterGrid{}; // clusters along xyz, w is the number of lights
     };
     
     struct FrameInfo {
@@ -24,7 +26,7 @@ namespace svk {
         VkCommandBuffer commandBuffer;
         Camera &camera;
         VkDescriptorSet globalDescriptorSet;
-        DescriptorPool &frameDescriptorPool;
-        GameObj::Map &gameObjs;
+        GameObjectManager &gameObjectManager;
+        JobSystem &jobSystem;
     };
 }
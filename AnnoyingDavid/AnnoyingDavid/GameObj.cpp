@@ -1,5 +1,7 @@
 ﻿#include "GameObj.h"
+#include "TransformBatch.h"
 
+#include <bit>
 #include <numeric>
 
 namespace svk {
@@ -54,49 +56,174 @@ namespace svk {
                     invScale.z * (c1 * c2)}};
     }
     
-    GameObj& GameObjectManager::makePointLight(float intensity, float radius, glm::vec3 color) {
-        auto& gameObj = createGameObject();
-        gameObj.color = color;
-        gameObj.transform.scale.x = radius;
-        gameObj.pointLight = std::make_unique<PointLightComponent>();
-        gameObj.pointLight->lightIntensity = intensity;
+    GameObj GameObjectManager::createGameObject() {
+        GameObj::id_t id;
+        if (!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+        }
+        else {
+            assert(currentId < MAX_GAME_OBJECTS && "Max game object count exceeded!");
+            id = currentId++;
+            sparse.push_back(INVALID_INDEX);
+            lightSparse.push_back(INVALID_INDEX);
+        }
+
+        sparse[id] = static_cast<uint32_t>(ids.size());
+        ids.push_back(id);
+        transforms.emplace_back();
+        models.emplace_back();
+        diffuseMaps.push_back(textureDefault);
+        specularMaps.emplace_back();
+        colors.emplace_back();
+        markDirty(id);
+        return GameObj{id, *this};
+    }
+
+    GameObj GameObjectManager::makePointLight(float intensity, float radius, glm::vec3 color) {
+        auto gameObj = createGameObject();
+        gameObj.color() = color;
+        gameObj.transform().scale.x = radius;
+
+        lightSparse[gameObj.getId()] = static_cast<uint32_t>(lightIds.size());
+        lightIds.push_back(gameObj.getId());
+        lights.push_back(PointLightComponent{intensity});
         return gameObj;
     }
 
+    // moves the last element of every dense array into the removed slot
+    template <typename T>
+    static void swapRemove(std::vector<T>& dense, uint32_t index) {
+        if (index != dense.size() - 1) { dense[index] = std::move(dense.back()); }
+        dense.pop_back();
+    }
+
+    void GameObjectManager::destroyGameObject(GameObj::id_t id) {
+        assert(isAlive(id) && "Game object does not exist");
+        uint32_t index = sparse[id];
+        sparse[ids.back()] = index;
+        sparse[id] = INVALID_INDEX;
+        swapRemove(ids, index);
+        swapRemove(transforms, index);
+        swapRemove(models, index);
+        swapRemove(diffuseMaps, index);
+        swapRemove(specularMaps, index);
+        swapRemove(colors, index);
+
+        uint32_t lightIndex = lightSparse[id];
+        if (lightIndex != INVALID_INDEX) {
+            lightSparse[lightIds.back()] = lightIndex;
+            lightSparse[id] = INVALID_INDEX;
+            swapRemove(lightIds, lightIndex);
+            swapRemove(lights, lightIndex);
+        }
+        freeIds.push_back(id);
+    }
+
     GameObjectManager::GameObjectManager(Device& device) {
-        int alignment = std::lcm(device.properties.limits.nonCoherentAtomSize,
-            device.properties.limits.minUniformBufferOffsetAlignment);
-        for (int i = 0; i < uboBuffers.size(); i++) {
-            uboBuffers[i] = std::make_unique<Buffer>(
+        // tightly packed so the instanced shaders can read it as one std430 array
+        for (int i = 0; i < objectBuffers.size(); i++) {
+            objectBuffers[i] = std::make_unique<Buffer>(
                 device,
                 sizeof(GameObjectBufferData),
                 GameObjectManager::MAX_GAME_OBJECTS,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                alignment);
-            uboBuffers[i]->map();
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            objectBuffers[i]->map();
         }
         textureDefault = Texture::createTextureFromFile(device, "textures/missing.jpg");
+
+        constexpr size_t wordCount = (MAX_GAME_OBJECTS + 63) / 64;
+        dirtyBits.assign(SwapChain::MAX_FRAMES_IN_FLIGHT, std::vector<uint64_t>(wordCount, 0));
+        staleMatrices.assign(wordCount, 0);
+        matrices.resize(MAX_GAME_OBJECTS);
+    }
+
+    void GameObjectManager::markDirty(GameObj::id_t id) {
+        uint64_t bit = 1ull << (id % 64);
+        for (auto& bits : dirtyBits) { bits[id / 64] |= bit; }
+        staleMatrices[id / 64] |= bit;
     }
 
-    void GameObjectManager::updateBuffer(int frameIndex) {
-        // copy model matrix and normal matrix for each gameObj into
-        // buffer for this frame
-        for (auto& kv : gameObjects) {
-            auto& obj = kv.second;
-            GameObjectBufferData data{};
-            data.modelMatrix = obj.transform.mat4();
-            data.normalMatrix = obj.transform.normalMatrix();
-            uboBuffers[frameIndex]->writeToIndex(&data, kv.first);
+    void GameObjectManager::updateBuffer(int frameIndex, JobSystem& jobSystem) {
+        // copy model matrix and normal matrix of every changed gameObj into
+        // buffer for this frame, adjacent ids are flushed as one range
+        auto& bits = dirtyBits[frameIndex];
+        auto& buffer = *objectBuffers[frameIndex];
+        VkDeviceSize stride = buffer.getAlignmentSize();
+
+        // everything changed since the last update is recomputed in one batch,
+        // the other frames in flight reuse these matrices
+        writeIds.clear();
+        batchIds.clear();
+        batchTransforms.clear();
+        for (size_t word = 0; word < bits.size(); word++) {
+            uint64_t stale = staleMatrices[word];
+            staleMatrices[word] &= ~bits[word];
+            while (bits[word] != 0) {
+                auto id = static_cast<GameObj::id_t>(word * 64 + std::countr_zero(bits[word]));
+                bits[word] &= bits[word] - 1;
+                if (!isAlive(id)) { continue; }
+                writeIds.push_back(id);
+                if (stale & (1ull << (id % 64))) {
+                    batchIds.push_back(id);
+                    batchTransforms.push_back(transforms[sparse[id]]);
+                }
+            }
         }
-        uboBuffers[frameIndex]->flush();
+
+        // every chunk touches its own ids only, both in matrices and in the mapped buffer
+        batchMatrices.resize(batchIds.size());
+        jobSystem.parallelFor(batchIds.size(), 256, [this](size_t begin, size_t end) {
+            computeTransforms(batchTransforms.data() + begin, end - begin, batchMatrices.data() + begin);
+            for (size_t i = begin; i < end; i++) { matrices[batchIds[i]] = batchMatrices[i]; }
+        });
+        jobSystem.parallelFor(writeIds.size(), 256, [this, &buffer](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) { buffer.writeToIndex(&matrices[writeIds[i]], writeIds[i]); }
+        });
+
+        GameObj::id_t rangeBegin = 0;
+        GameObj::id_t rangeEnd = 0;
+        for (auto id : writeIds) {
+            if (id != rangeEnd) {
+                if (rangeEnd > rangeBegin) { buffer.flush((rangeEnd - rangeBegin) * stride, rangeBegin * stride); }
+                rangeBegin = id;
+            }
+            rangeEnd = id + 1;
+        }
+        if (rangeEnd > rangeBegin) { buffer.flush((rangeEnd - rangeBegin) * stride, rangeBegin * stride); }
+    }
+
+    VkDescriptorBufferInfo GameObj::getBufferInfo(int frameIndex) const {
+        return gameObjectManger->getBufferInfoForGameObject(frameIndex, id);
+    }
+
+    TransfromComponent& GameObj::transform() {
+        gameObjectManger->markDirty(id);
+        return gameObjectManger->getTransforms()[gameObjectManger->indexOf(id)];
+    }
+
+    std::shared_ptr<Model>& GameObj::model() const {
+        return gameObjectManger->getModels()[gameObjectManger->indexOf(id)];
+    }
+
+    std::shared_ptr<Texture>& GameObj::diffuseMap() const {
+        return gameObjectManger->getDiffuseMaps()[gameObjectManger->indexOf(id)];
+    }
+
+    std::shared_ptr<Texture>& GameObj::specularMap() const {
+        return gameObjectManger->getSpecularMaps()[gameObjectManger->indexOf(id)];
+    }
+
+    glm::vec3& GameObj::color() const {
+        return gameObjectManger->getColors()[gameObjectManger->indexOf(id)];
     }
 
-    VkDescriptorBufferInfo GameObj::getBufferInfo(int frameIndex) {
-        return gameObjectManger.getBufferInfoForGameObject(frameIndex, id);
+    PointLightComponent* GameObj::pointLight() const {
+        return gameObjectManger->findLight(id);
     }
 
-    GameObj::GameObj(id_t objId, const GameObjectManager& manager)
-    : id{objId}, gameObjectManger{manager} {}
+    GameObj::GameObj(id_t objId, GameObjectManager& manager)
+    : id{objId}, gameObjectManger{&manager} {}
     
 }
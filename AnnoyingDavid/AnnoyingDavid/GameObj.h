@@ -1,6 +1,9 @@
 ﻿#pragma once
+#include <cassert>
 #include <memory>
+#include <vector>
 #include <glm/gtc/matrix_transform.hpp>
+#include "JobSystem.h"
 #include "Model.h"
 #include "SwapChain.h"
 #include "Texture.h"
@@ -29,42 +32,42 @@ namespace svk {
         glm::mat4 normalMatrix{1.0f};
     };
 
-    class GameObjectManager; 
-    
+    class GameObjectManager;
+
+    // Handle into the GameObjectManager's component arrays, cheap to copy around.
+    // References returned by the accessors are only valid until an object is created or destroyed.
     class GameObj {
     public:
         using id_t = unsigned int;
-        using Map = std::unordered_map<id_t, GameObj>;
-        
-        GameObj(GameObj &&) = default;
-        GameObj(const GameObj &) = delete;
-        GameObj &operator=(const GameObj &) = delete;
-        GameObj &operator=(GameObj &&) = delete;
 
-        id_t getId(){ return id; }
+        id_t getId() const { return id; }
+
+        VkDescriptorBufferInfo getBufferInfo(int frameIndex) const;
+
+        // marks the transform dirty, read through the manager's arrays when only looking
+        TransfromComponent &transform();
+        std::shared_ptr<Model> &model() const;
+        std::shared_ptr<Texture> &diffuseMap() const;
+        std::shared_ptr<Texture> &specularMap() const;
+        glm::vec3 &color() const;
+        // nullptr when the object is not a light
+        PointLightComponent *pointLight() const;
 
-        VkDescriptorBufferInfo getBufferInfo(int frameIndex);
-        
-        std::shared_ptr<Model> model{};
-        std::shared_ptr<Texture> diffuseMap = nullptr;
-        
-        std::shared_ptr<Texture> specularMap = nullptr;
-        
-        glm::vec3 color{};
-        TransfromComponent transform{};
-        std::unique_ptr<PointLightComponent> pointLight = nullptr;
-        
     private:
-        GameObj(id_t objId, const GameObjectManager &manager);
+        GameObj(id_t objId, GameObjectManager &manager);
 
         id_t id;
-        const GameObjectManager &gameObjectManger;
+        GameObjectManager *gameObjectManger;
         friend class GameObjectManager;
     };
 
+    // Components are stored in dense arrays, index i of every array belongs to the object ids[i].
+    // Ids stay stable, a sparse array maps them to their current dense index. Lights are a second
+    // sparse set so systems that only care about lights never walk the other objects.
     class GameObjectManager {
     public:
         static constexpr int MAX_GAME_OBJECTS = 1000;
+        static constexpr uint32_t INVALID_INDEX = ~0u;
 
         GameObjectManager(Device &device);
         GameObjectManager(const GameObjectManager &) = delete;
@@ -72,30 +75,77 @@ namespace svk {
         GameObjectManager(GameObjectManager &&) = delete;
         GameObjectManager &operator=(GameObjectManager &&) = delete;
 
-        GameObj &createGameObject() {
-            assert(currentId < MAX_GAME_OBJECTS && "Max game object count exceeded!");
-            usedIds.push_back(currentId);
-            auto gameObject = GameObj{currentId++, *this};
-            
-            auto gameObjectId = gameObject.getId();
-            gameObject.diffuseMap = textureDefault;
-            gameObjects.emplace(gameObjectId, std::move(gameObject));
-            return gameObjects.at(gameObjectId);
-        }
+        GameObj createGameObject();
+        GameObj makePointLight(float intensity = 10.0f, float radius = 0.1f, glm::vec3 color = glm::vec3(1.0f));
+        // swaps the last object into the hole, dense indices of other objects may change
+        void destroyGameObject(GameObj::id_t id);
 
-        GameObj &makePointLight(float intensity = 10.0f, float radius = 0.1f, glm::vec3 color = glm::vec3(1.0f));
+        GameObj getGameObject(GameObj::id_t id) {
+            assert(isAlive(id) && "Game object does not exist");
+            return GameObj{id, *this};
+        }
+        bool isAlive(GameObj::id_t id) const { return id < sparse.size() && sparse[id] != INVALID_INDEX; }
+        uint32_t indexOf(GameObj::id_t id) const { return sparse[id]; }
 
         VkDescriptorBufferInfo getBufferInfoForGameObject(int frameIndex, GameObj::id_t gameObjectId) const {
-            return uboBuffers[frameIndex]->descriptorInfoForIndex(gameObjectId);
+            return objectBuffers[frameIndex]->descriptorInfoForIndex(gameObjectId);
+        }
+        // the whole storage buffer, shaders index it with the game object id
+        VkDescriptorBufferInfo getBufferInfo(int frameIndex) const {
+            return objectBuffers[frameIndex]->descriptorInfo();
         }
 
-        void updateBuffer(int frameIndex);
+        // only recomputes and writes objects whose transform changed since this frame's buffer was written
+        void updateBuffer(int frameIndex, JobSystem &jobSystem);
+        void markDirty(GameObj::id_t id);
+        // matrices as of the last updateBuffer
+        const GameObjectBufferData &getObjectData(GameObj::id_t id) const { return matrices[id]; }
+
+        // dense component arrays, all of size()
+        size_t size() const { return ids.size(); }
+        const std::vector<GameObj::id_t> &getIds() const { return ids; }
+        const std::vector<TransfromComponent> &getTransforms() const { return transforms; }
+        std::vector<std::shared_ptr<Model>> &getModels() { return models; }
+        std::vector<std::shared_ptr<Texture>> &getDiffuseMaps() { return diffuseMaps; }
+        std::vector<std::shared_ptr<Texture>> &getSpecularMaps() { return specularMaps; }
+        std::vector<glm::vec3> &getColors() { return colors; }
+        // what new objects start with, also bound wherever a material leaves a texture slot empty
+        const std::shared_ptr<Texture> &getDefaultTexture() const { return textureDefault; }
+
+        // dense light arrays, all of lightCount()
+        size_t lightCount() const { return lightIds.size(); }
+        const std::vector<GameObj::id_t> &getLightIds() const { return lightIds; }
+        std::vector<PointLightComponent> &getLights() { return lights; }
+        PointLightComponent *findLight(GameObj::id_t id) {
+            return id < lightSparse.size() && lightSparse[id] != INVALID_INDEX ? &lights[lightSparse[id]] : nullptr;
+        }
 
-        GameObj::Map gameObjects{};
-        std::vector<std::unique_ptr<Buffer>> uboBuffers{SwapChain::MAX_FRAMES_IN_FLIGHT};
-        std::vector<GameObj::id_t> usedIds;
+        std::vector<std::unique_ptr<Buffer>> objectBuffers{SwapChain::MAX_FRAMES_IN_FLIGHT};
 
     private:
+        std::vector<GameObj::id_t> ids;
+        std::vector<TransfromComponent> transforms;
+        std::vector<std::shared_ptr<Model>> models;
+        std::vector<std::shared_ptr<Texture>> diffuseMaps;
+        std::vector<std::shared_ptr<Texture>> specularMaps;
+        std::vector<glm::vec3> colors;
+        std::vector<uint32_t> sparse;
+
+        std::vector<GameObj::id_t> lightIds;
+        std::vector<PointLightComponent> lights;
+        std::vector<uint32_t> lightSparse;
+
+        // bit per id, one set per frame in flight plus one for the cached matrices
+        std::vector<std::vector<uint64_t>> dirtyBits;
+        std::vector<uint64_t> staleMatrices;
+        std::vector<GameObjectBufferData> matrices; // by id, what was last written to the buffers
+        std::vector<GameObj::id_t> writeIds;
+        std::vector<GameObj::id_t> batchIds;
+        std::vector<TransfromComponent> batchTransforms;
+        std::vector<GameObjectBufferData> batchMatrices;
+
+        // ids index the gpu buffers, so destroyed ones are handed out again before new ones
+        std::vector<GameObj::id_t> freeIds;
         GameObj::id_t currentId = 0;
         std::shared_ptr<Texture> textureDefault;
     };
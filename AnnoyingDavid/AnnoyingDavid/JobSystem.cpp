@@ -0,0 +1,156 @@
+﻿#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <exception>
+
+namespace svk {
+    // First exception thrown by the jobs of one run or parallelFor, rethrown on the waiting thread
+    // once every job has finished, an exception escaping a worker would terminate the process.
+    class JobErrors {
+    public:
+        template <typename F>
+        void invoke(F&& f) noexcept {
+            try {
+                f();
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) { error = std::current_exception(); }
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        bool hasFailed() const { return failed.load(std::memory_order_relaxed); }
+        void rethrow() { if (error) { std::rethrow_exception(error); } }
+
+    private:
+        std::mutex mutex;
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+    };
+
+    JobSystem::TaskGraph::TaskId JobSystem::TaskGraph::add(Job job, std::initializer_list<TaskId> dependencies) {
+        auto id = static_cast<TaskId>(tasks.size());
+        auto task = std::make_unique<Task>();
+        task->job = std::move(job);
+        for (auto dependency : dependencies) {
+            assert(dependency < id && "Tasks can only depend on tasks added before them");
+            tasks[dependency]->dependents.push_back(id);
+            task->dependencyCount++;
+        }
+        tasks.push_back(std::move(task));
+        return id;
+    }
+
+    JobSystem::JobSystem(uint32_t workerCount) {
+        if (workerCount == 0) {
+            workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        }
+        workers.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    JobSystem::~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) { worker.join(); }
+    }
+
+    void JobSystem::run(TaskGraph& graph) {
+        auto& tasks = graph.tasks;
+        std::atomic<size_t> pending{tasks.size()};
+        JobErrors errors;
+        for (auto& task : tasks) { task->remaining.store(task->dependencyCount, std::memory_order_relaxed); }
+
+        std::function<void(TaskGraph::TaskId)> launch = [&](TaskGraph::TaskId id) {
+            enqueue([&, id] {
+                auto& task = *tasks[id];
+                // once a task failed the rest are only counted down, their inputs may be missing
+                if (!errors.hasFailed()) { errors.invoke(task.job); }
+                for (auto dependent : task.dependents) {
+                    if (tasks[dependent]->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) { launch(dependent); }
+                }
+                // last, run() may return as soon as this hits zero
+                pending.fetch_sub(1, std::memory_order_release);
+            });
+        };
+        for (TaskGraph::TaskId id = 0; id < tasks.size(); id++) {
+            if (tasks[id]->dependencyCount == 0) { launch(id); }
+        }
+        waitFor(pending);
+        errors.rethrow();
+    }
+
+    void JobSystem::parallelFor(size_t count, size_t minChunk,
+                                const std::function<void(size_t begin, size_t end)>& body) {
+        if (count == 0) { return; }
+        size_t chunkCount = std::min(std::max<size_t>(count / std::max<size_t>(minChunk, 1), 1),
+                                     workers.size() + 1);
+        if (chunkCount == 1) {
+            body(0, count);
+            return;
+        }
+
+        size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        std::atomic<size_t> pending{chunkCount - 1};
+        JobErrors errors;
+        for (size_t chunk = 1; chunk < chunkCount; chunk++) {
+            size_t begin = chunk * chunkSize;
+            size_t end = std::min(begin + chunkSize, count);
+            enqueue([&body, &pending, &errors, begin, end] {
+                if (begin < end) { errors.invoke([&] { body(begin, end); }); }
+                pending.fetch_sub(1, std::memory_order_release);
+            });
+        }
+        // the calling thread takes the first chunk itself, the others still reference this frame until they are done
+        errors.invoke([&] { body(0, std::min(chunkSize, count)); });
+        waitFor(pending);
+        errors.rethrow();
+    }
+
+    void JobSystem::enqueue(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(job));
+        }
+        wake.notify_one();
+    }
+
+    bool JobSystem::runOne() {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.empty()) { return false; }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        job();
+        return true;
+    }
+
+    void JobSystem::waitFor(const std::atomic<size_t>& pending) {
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (!runOne()) { std::this_thread::yield(); }
+        }
+    }
+
+    void JobSystem::workerLoop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping && queue.empty()) { return; }
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            job();
+        }
+    }
+}
@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace svk {
+    // Fixed pool of worker threads sharing one job queue. Threads that wait on work (run, parallelFor)
+    // execute queued jobs in the meantime, so jobs may start nested parallel work without deadlocking.
+    class JobSystem {
+    public:
+        using Job = std::function<void()>;
+
+        // tasks with dependencies, built once per frame and handed to run()
+        class TaskGraph {
+        public:
+            using TaskId = uint32_t;
+
+            TaskId add(Job job, std::initializer_list<TaskId> dependencies = {});
+            void clear() { tasks.clear(); }
+
+        private:
+            struct Task {
+                Job job;
+                std::vector<TaskId> dependents;
+                uint32_t dependencyCount = 0;
+                std::atomic<uint32_t> remaining{0};
+            };
+
+            std::vector<std::unique_ptr<Task>> tasks;
+            friend class JobSystem;
+        };
+
+        // 0 uses one worker per core besides the calling thread
+        explicit JobSystem(uint32_t workerCount = 0);
+        ~JobSystem();
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        // starts every task once its dependencies finished, returns when all of them are done
+        void run(TaskGraph& graph);
+        // splits [0, count) into chunks of at least minChunk items, returns when all chunks are done
+        void parallelFor(size_t count, size_t minChunk, const std::function<void(size_t begin, size_t end)>& body);
+        // hands the job to a worker and returns right away, the job has to report back on its own
+        void submit(Job job) { enqueue(std::move(job)); }
+
+        uint32_t getWorkerCount() const { return static_cast<uint32_t>(workers.size()); }
+
+    private:
+        void enqueue(Job job);
+        bool runOne();
+        void waitFor(const std::atomic<size_t>& pending);
+        void workerLoop();
+
+        std::vector<std::thread> workers;
+        std::deque<Job> queue;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+    };
+}
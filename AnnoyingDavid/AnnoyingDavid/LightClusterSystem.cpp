@@ -0,0 +1,129 @@
+﻿#include "LightClusterSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+#include "SwapChain.h"
+
+namespace svk {
+    LightClusterSystem::LightClusterSystem(Device& dev, VkDescriptorSetLayout globalSetLayout) : device{dev} {
+        createPipeline(globalSetLayout);
+        frames.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        for (auto& frame : frames) {
+            frame.clusters = std::make_unique<Buffer>(device, 2 * sizeof(uint32_t), CLUSTER_COUNT,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.clustersInfo = frame.clusters->descriptorInfo();
+        }
+    }
+
+    LightClusterSystem::~LightClusterSystem() {
+        vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr);
+    }
+
+    void LightClusterSystem::prepareFrame(int frameIndex, size_t lightCount) {
+        // the fence of this frame has been waited on, its old buffers are free to go
+        auto& frame = frames[frameIndex];
+        if (!frame.lights || frame.lights->getInstanceCount() < lightCount) {
+            uint32_t capacity = frame.lights ? frame.lights->getInstanceCount() : MIN_LIGHT_CAPACITY;
+            while (capacity < lightCount) { capacity *= 2; }
+            frame.lights = std::make_unique<Buffer>(device, sizeof(PointLight), capacity,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.lights->map();
+            frame.lightsInfo = frame.lights->descriptorInfo();
+        }
+
+        // enough for every cluster to hold every light up to the per cluster limit, so the list never overflows
+        uint32_t perCluster = std::clamp<uint32_t>(static_cast<uint32_t>(lightCount), 1, MAX_LIGHTS_PER_CLUSTER);
+        uint32_t indexCapacity = CLUSTER_COUNT * perCluster;
+        if (!frame.lightIndices || frame.lightIndices->getInstanceCount() < indexCapacity + 1) {
+            frame.lightIndices = std::make_unique<Buffer>(device, sizeof(uint32_t), indexCapacity + 1,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.lightIndicesInfo = frame.lightIndices->descriptorInfo();
+        }
+    }
+
+    DescriptorWriter& LightClusterSystem::writeDescriptors(int frameIndex, DescriptorWriter& writer) {
+        auto& frame = frames[frameIndex];
+        return writer.writeBuffer(1, &frame.lightsInfo).writeBuffer(2, &frame.clustersInfo)
+            .writeBuffer(3, &frame.lightIndicesInfo);
+    }
+
+    void LightClusterSystem::update(FrameInfo& frameInfo, GlobalUbo& ubo, VkExtent2D extent) {
+        auto& frame = frames[frameInfo.frameIndex];
+        auto& manager = frameInfo.gameObjectManager;
+        auto& lights = manager.getLights();
+        assert(manager.lightCount() <= frame.lights->getInstanceCount() && "prepareFrame was not called");
+
+        auto* data = static_cast<PointLight*>(frame.lights->getMappedMemory());
+        for (size_t i = 0; i < manager.lightCount(); i++) {
+            uint32_t index = manager.indexOf(manager.getLightIds()[i]);
+            glm::vec3 color = manager.getColors()[index];
+            float intensity = lights[i].lightIntensity;
+            // attenuation is intensity / d^2, past the radius it stays below the cutoff
+            float brightest = intensity * std::max(color.r, std::max(color.g, color.b));
+            float radius = std::sqrt(std::max(brightest, 0.0f) / LIGHT_CUTOFF);
+            data[i].position = glm::vec4(manager.getTransforms()[index].translation, radius);
+            data[i].color = glm::vec4(color, intensity);
+        }
+        frame.lights->flush();
+
+        // slice = log(z) * scale + bias spreads the slices exponentially between near and far
+        float nearPlane = frameInfo.camera.getNear();
+        float farPlane = frameInfo.camera.getFar();
+        float scale = static_cast<float>(CLUSTERS_Z) / std::log(farPlane / nearPlane);
+        float bias = -scale * std::log(nearPlane);
+        ubo.clusterParams = glm::vec4(static_cast<float>(extent.width), static_cast<float>(extent.height), scale,
+            bias);
+        ubo.clusterGrid = glm::uvec4(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, static_cast<uint32_t>(manager.lightCount()));
+    }
+
+    void LightClusterSystem::dispatch(FrameInfo& frameInfo) {
+        auto& frame = frames[frameInfo.frameIndex];
+        VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+        vkCmdFillBuffer(commandBuffer, frame.lightIndices->getBuffer(), 0, sizeof(uint32_t), 0);
+
+        VkMemoryBarrier clearBarrier{};
+        clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+        pipeline->bind(commandBuffer);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+            0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+        ClusterPushConstant push{};
+        push.indexCapacity = frame.lightIndices->getInstanceCount() - 1;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+            sizeof(ClusterPushConstant), &push);
+        vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + CLUSTER_GROUP_SIZE - 1) / CLUSTER_GROUP_SIZE, 1, 1);
+
+        VkMemoryBarrier clusterBarrier{};
+        clusterBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clusterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        clusterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &clusterBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void LightClusterSystem::createPipeline(VkDescriptorSetLayout globalSetLayout) {
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(ClusterPushConstant);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &globalSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+        pipeline = std::make_unique<ComputePipeline>(device, "shaders/cluster_lights.comp.spv", pipelineLayout);
+    }
+}
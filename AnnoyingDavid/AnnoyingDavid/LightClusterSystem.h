@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <memory>
+#include <vector>
+
+#include "Buffer.h"
+#include "Descriptors.h"
+#include "FrameInfo.h"
+#include "Pipeline.h"
+
+namespace svk {
+    // Clustered forward lighting. Lights live in a storage buffer that grows with the scene, a compute pass
+    // bins them into a view space grid of screen tiles and exponential depth slices, and shader1.frag only
+    // loops over the lights of its own cluster. Bindings 1 to 3 of the global set belong to this system.
+    class LightClusterSystem {
+    public:
+        static constexpr uint32_t CLUSTERS_X = 16;
+        static constexpr uint32_t CLUSTERS_Y = 9;
+        static constexpr uint32_t CLUSTERS_Z = 24;
+        static constexpr uint32_t CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+        // matches cluster_lights.comp, lights past this in one cluster are dropped
+        static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+        // attenuation a light is cut off at, decides its radius
+        static constexpr float LIGHT_CUTOFF = 1.0f / 256.0f;
+
+        LightClusterSystem(Device& dev, VkDescriptorSetLayout globalSetLayout);
+        ~LightClusterSystem();
+
+        LightClusterSystem(const LightClusterSystem&) = delete;
+        LightClusterSystem& operator=(const LightClusterSystem&) = delete;
+
+        // grows the frame's buffers to fit lightCount, before the global set of the frame is written
+        void prepareFrame(int frameIndex, size_t lightCount);
+        // bindings 1 to 3 of the global set, the infos stay valid until the next prepareFrame
+        DescriptorWriter& writeDescriptors(int frameIndex, DescriptorWriter& writer);
+        // fills the light buffer and the cluster fields of the ubo, once the lights moved
+        void update(FrameInfo& frameInfo, GlobalUbo& ubo, VkExtent2D extent);
+        // records the binning, outside a render pass and before anything shades with the clusters
+        void dispatch(FrameInfo& frameInfo);
+
+    private:
+        struct FrameResources {
+            std::unique_ptr<Buffer> lights;
+            std::unique_ptr<Buffer> clusters; // offset and count into lightIndices per cluster
+            std::unique_ptr<Buffer> lightIndices; // a counter, then the lists of all clusters back to back
+            VkDescriptorBufferInfo lightsInfo{};
+            VkDescriptorBufferInfo clustersInfo{};
+            VkDescriptorBufferInfo lightIndicesInfo{};
+        };
+
+        struct ClusterPushConstant {
+            uint32_t indexCapacity;
+        };
+
+        static constexpr uint32_t MIN_LIGHT_CAPACITY = 64;
+        static constexpr uint32_t CLUSTER_GROUP_SIZE = 64;
+
+        void createPipeline(VkDescriptorSetLayout globalSetLayout);
+
+        Device& device;
+        std::unique_ptr<ComputePipeline> pipeline;
+        VkPipelineLayout pipelineLayout{};
+        std::vector<FrameResources> frames;
+    };
+}
@@ -0,0 +1,55 @@
+﻿#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace svk {
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& filepath) {
+        HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) { return; }
+        fileHandle = file;
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) { return; }
+        mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle == nullptr) { return; }
+        mapped = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (mapped != nullptr) { fileSize = static_cast<size_t>(size.QuadPart); }
+    }
+
+    MappedFile::~MappedFile() {
+        if (mapped != nullptr) { UnmapViewOfFile(mapped); }
+        if (mappingHandle != nullptr) { CloseHandle(mappingHandle); }
+        if (fileHandle != nullptr) { CloseHandle(fileHandle); }
+    }
+#else
+    MappedFile::MappedFile(const std::string& filepath) {
+        int file = open(filepath.c_str(), O_RDONLY);
+        if (file < 0) { return; }
+        struct stat info{};
+        if (fstat(file, &info) == 0 && info.st_size > 0) {
+            void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if (view != MAP_FAILED) {
+                mapped = view;
+                fileSize = static_cast<size_t>(info.st_size);
+            }
+        }
+        // the mapping keeps the file alive on its own
+        close(file);
+    }
+
+    MappedFile::~MappedFile() {
+        if (mapped != nullptr) { munmap(const_cast<void*>(mapped), fileSize); }
+    }
+#endif
+}
@@ -0,0 +1,28 @@
+﻿#pragma once
+#include <cstddef>
+#include <string>
+
+namespace svk {
+    // Read only view of a whole file through the os page cache, nothing is copied until it is touched.
+    // Empty or missing files are never mapped, check isOpen().
+    class MappedFile {
+    public:
+        MappedFile(const std::string& filepath);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool isOpen() const { return mapped != nullptr; }
+        const void* data() const { return mapped; }
+        size_t size() const { return fileSize; }
+
+    private:
+        const void* mapped = nullptr;
+        size_t fileSize = 0;
+#ifdef _WIN32
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#endif
+    };
+}
@@ -0,0 +1,266 @@
+﻿#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+
+namespace svk {
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static VkDeviceSize alignDown(VkDeviceSize value, VkDeviceSize alignment) {
+        return value / alignment * alignment;
+    }
+
+    float HeapStats::fragmentation() const {
+        VkDeviceSize freeBytes = bytesReserved - bytesUsed;
+        if (freeBytes == 0) { return 0.0f; }
+        return 1.0f - static_cast<float>(largestFreeRange) / static_cast<float>(freeBytes);
+    }
+
+    MemoryAllocator::MemoryAllocator(VkDevice dev, VkPhysicalDevice physicalDevice) : device{dev} {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(physicalDevice, &props);
+        nonCoherentAtomSize = std::max<VkDeviceSize>(props.limits.nonCoherentAtomSize, 1);
+        heapBudgets.resize(memoryProperties.memoryHeapCount, 0);
+    }
+
+    MemoryAllocator::~MemoryAllocator() {
+        for (auto& block : blocks) {
+            assert(block->allocationCount == 0 && "Device memory leaked, allocation still alive on shutdown");
+            if (block->mapped) { vkUnmapMemory(device, block->memory); }
+            vkFreeMemory(device, block->memory, nullptr);
+        }
+        blocks.clear();
+    }
+
+    uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) &&
+                (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkDeviceSize MemoryAllocator::preferredBlockSize(uint32_t memoryTypeIndex) const {
+        // small heaps (e.g. the 256MB host visible vram window) get proportionally smaller blocks
+        uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        VkDeviceSize heapSize = memoryProperties.memoryHeaps[heapIndex].size;
+        return std::min(DEFAULT_BLOCK_SIZE, heapSize / 8);
+    }
+
+    Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements,
+                                         VkMemoryPropertyFlags properties, bool linear) {
+        uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Allocation allocation{};
+        VkDeviceSize blockSize = preferredBlockSize(memoryTypeIndex);
+
+        // big resources get their own vkAllocateMemory, they would only fragment the blocks
+        if (requirements.size > blockSize / 2) {
+            MemoryBlock* block = createBlock(memoryTypeIndex, alignUp(requirements.size, nonCoherentAtomSize),
+                linear, true);
+            suballocate(*block, requirements, allocation);
+            return allocation;
+        }
+
+        for (auto& block : blocks) {
+            if (block->dedicated || block->linear != linear || block->memoryTypeIndex != memoryTypeIndex) {
+                continue;
+            }
+            if (suballocate(*block, requirements, allocation)) { return allocation; }
+        }
+
+        MemoryBlock* block = createBlock(memoryTypeIndex, blockSize, linear, false);
+        if (!suballocate(*block, requirements, allocation)) {
+            throw std::runtime_error("failed to sub allocate device memory!");
+        }
+        return allocation;
+    }
+
+    void MemoryAllocator::free(Allocation& allocation) {
+        if (allocation.block == nullptr) { return; }
+        std::lock_guard<std::mutex> lock(mutex);
+
+        MemoryBlock* block = allocation.block;
+        block->used -= allocation.size;
+        block->allocationCount--;
+
+        // give the range back and merge it with its neighbours
+        VkDeviceSize offset = allocation.offset;
+        VkDeviceSize size = allocation.size;
+        auto next = block->freeRanges.lower_bound(offset);
+        if (next != block->freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = block->freeRanges.erase(next);
+        }
+        if (next != block->freeRanges.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                size += prev->second;
+                block->freeRanges.erase(prev);
+            }
+        }
+        block->freeRanges[offset] = size;
+
+        if (block->allocationCount == 0) {
+            // keep one empty block per memory type around so load/unload cycles do not thrash the driver
+            bool hasOtherEmpty = std::any_of(blocks.begin(), blocks.end(), [block](const auto& other) {
+                return other.get() != block && !other->dedicated && other->allocationCount == 0 &&
+                    other->memoryTypeIndex == block->memoryTypeIndex && other->linear == block->linear;
+            });
+            if (block->dedicated || hasOtherEmpty) { destroyBlock(block); }
+        }
+        allocation = Allocation{};
+    }
+
+    MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool linear,
+                                              bool dedicated) {
+        uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+        if (heapBudgets[heapIndex] > 0) {
+            VkDeviceSize reserved = 0;
+            for (auto& block : blocks) {
+                if (memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex == heapIndex) {
+                    reserved += block->size;
+                }
+            }
+            if (reserved + size > heapBudgets[heapIndex]) {
+                throw std::runtime_error("device memory budget exceeded!");
+            }
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+        auto block = std::make_unique<MemoryBlock>();
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory block!");
+        }
+        block->size = size;
+        block->memoryTypeIndex = memoryTypeIndex;
+        block->dedicated = dedicated;
+        block->linear = linear;
+        block->freeRanges[0] = size;
+
+        // host visible blocks stay mapped for their whole life, buffers just hand out pointers into it
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+                throw std::runtime_error("failed to map device memory block!");
+            }
+        }
+
+        blocks.push_back(std::move(block));
+        return blocks.back().get();
+    }
+
+    void MemoryAllocator::destroyBlock(MemoryBlock* block) {
+        if (block->mapped) { vkUnmapMemory(device, block->memory); }
+        vkFreeMemory(device, block->memory, nullptr);
+        blocks.erase(std::find_if(blocks.begin(), blocks.end(),
+            [block](const auto& other) { return other.get() == block; }));
+    }
+
+    bool MemoryAllocator::suballocate(MemoryBlock& block, const VkMemoryRequirements& requirements,
+                                      Allocation& allocation) {
+        VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+        // host visible ranges are rounded to the atom size so flushing one never touches a neighbour
+        if (block.mapped) { alignment = std::max(alignment, nonCoherentAtomSize); }
+        VkDeviceSize size = block.mapped ? alignUp(requirements.size, nonCoherentAtomSize) : requirements.size;
+
+        for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+            VkDeviceSize rangeOffset = it->first;
+            VkDeviceSize rangeSize = it->second;
+            VkDeviceSize alignedOffset = alignUp(rangeOffset, alignment);
+            if (alignedOffset + size > rangeOffset + rangeSize) { continue; }
+
+            // first fit, padding in front and the tail both stay free
+            block.freeRanges.erase(it);
+            if (alignedOffset > rangeOffset) { block.freeRanges[rangeOffset] = alignedOffset - rangeOffset; }
+            VkDeviceSize tail = rangeOffset + rangeSize - (alignedOffset + size);
+            if (tail > 0) { block.freeRanges[alignedOffset + size] = tail; }
+
+            block.used += size;
+            block.allocationCount++;
+
+            allocation.memory = block.memory;
+            allocation.offset = alignedOffset;
+            allocation.size = size;
+            allocation.memoryTypeIndex = block.memoryTypeIndex;
+            allocation.block = &block;
+            allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + alignedOffset : nullptr;
+            return true;
+        }
+        return false;
+    }
+
+    VkMappedMemoryRange MemoryAllocator::mappedRange(const Allocation& allocation, VkDeviceSize size,
+                                                     VkDeviceSize offset) const {
+        VkDeviceSize begin = allocation.offset + offset;
+        VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+        begin = alignDown(begin, nonCoherentAtomSize);
+        end = std::min(alignUp(end, nonCoherentAtomSize), allocation.block->size);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = begin;
+        range.size = end - begin;
+        return range;
+    }
+
+    VkResult MemoryAllocator::flush(const Allocation& allocation, VkDeviceSize size, VkDeviceSize offset) {
+        auto flags = memoryProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags;
+        if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) { return VK_SUCCESS; }
+        auto range = mappedRange(allocation, size, offset);
+        return vkFlushMappedMemoryRanges(device, 1, &range);
+    }
+
+    VkResult MemoryAllocator::invalidate(const Allocation& allocation, VkDeviceSize size, VkDeviceSize offset) {
+        auto flags = memoryProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags;
+        if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) { return VK_SUCCESS; }
+        auto range = mappedRange(allocation, size, offset);
+        return vkInvalidateMappedMemoryRanges(device, 1, &range);
+    }
+
+    void MemoryAllocator::setHeapBudget(uint32_t heapIndex, VkDeviceSize bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        assert(heapIndex < heapBudgets.size() && "Heap index out of range");
+        heapBudgets[heapIndex] = bytes;
+    }
+
+    std::vector<HeapStats> MemoryAllocator::getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<HeapStats> stats(memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < stats.size(); i++) { stats[i].budget = heapBudgets[i]; }
+
+        for (auto& block : blocks) {
+            auto& heap = stats[memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex];
+            heap.bytesReserved += block->size;
+            heap.bytesUsed += block->used;
+            heap.blockCount++;
+            heap.allocationCount += block->allocationCount;
+            for (auto& kv : block->freeRanges) { heap.largestFreeRange = std::max(heap.largestFreeRange, kv.second); }
+        }
+        return stats;
+    }
+
+    void MemoryAllocator::printStats() const {
+        auto stats = getStats();
+        for (uint32_t i = 0; i < stats.size(); i++) {
+            auto& heap = stats[i];
+            if (heap.blockCount == 0) { continue; }
+            printf("heap %u: %.2f / %.2f MB used, %u blocks, %u allocations, fragmentation %.2f\n", i,
+                   heap.bytesUsed / (1024.0 * 1024.0), heap.bytesReserved / (1024.0 * 1024.0),
+                   heap.blockCount, heap.allocationCount, heap.fragmentation());
+        }
+    }
+}
@@ -0,0 +1,87 @@
+﻿#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+namespace svk {
+    struct MemoryBlock;
+
+    // a range inside one of the allocator's VkDeviceMemory blocks
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr; // only set for host visible memory, already offset
+        uint32_t memoryTypeIndex = 0;
+        MemoryBlock* block = nullptr;
+    };
+
+    struct HeapStats {
+        VkDeviceSize bytesReserved = 0; // sum of all vkAllocateMemory blocks
+        VkDeviceSize bytesUsed = 0; // sum of live sub allocations
+        VkDeviceSize largestFreeRange = 0;
+        VkDeviceSize budget = 0; // 0 means unbounded
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+
+        // 0 when all free space is one range, close to 1 when it is scattered in small holes
+        float fragmentation() const;
+    };
+
+    struct MemoryBlock {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        VkDeviceSize used = 0;
+        void* mapped = nullptr;
+        uint32_t memoryTypeIndex = 0;
+        uint32_t allocationCount = 0;
+        bool dedicated = false;
+        bool linear = true;
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges{}; // offset -> size
+    };
+
+    class MemoryAllocator {
+    public:
+        static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+        MemoryAllocator(VkDevice dev, VkPhysicalDevice physicalDevice);
+        ~MemoryAllocator();
+
+        MemoryAllocator(const MemoryAllocator&) = delete;
+        MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+        // linear resources (buffers) and optimal tiled images live in separate blocks,
+        // so bufferImageGranularity never has to be considered
+        Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+            bool linear);
+        void free(Allocation& allocation);
+
+        VkResult flush(const Allocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+        VkResult invalidate(const Allocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+        uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+        // allocating a new block on a heap that would go over its budget throws
+        void setHeapBudget(uint32_t heapIndex, VkDeviceSize bytes);
+        std::vector<HeapStats> getStats() const;
+        void printStats() const;
+
+    private:
+        VkDeviceSize preferredBlockSize(uint32_t memoryTypeIndex) const;
+        MemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated);
+        void destroyBlock(MemoryBlock* block);
+        bool suballocate(MemoryBlock& block, const VkMemoryRequirements& requirements, Allocation& allocation);
+        VkMappedMemoryRange mappedRange(const Allocation& allocation, VkDeviceSize size, VkDeviceSize offset) const;
+
+        VkDevice device;
+        VkPhysicalDeviceMemoryProperties memoryProperties{};
+        VkDeviceSize nonCoherentAtomSize = 1;
+
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<MemoryBlock>> blocks;
+        std::vector<VkDeviceSize> heapBudgets;
+    };
+}
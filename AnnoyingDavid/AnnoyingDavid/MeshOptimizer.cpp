@@ -0,0 +1,299 @@
+﻿#include "MeshOptimizer.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace svk {
+    // Forsyth's tuned constants, the scored cache is larger than real hardware on purpose
+    static constexpr uint32_t SCORE_CACHE_SIZE = 32;
+    static constexpr float CACHE_DECAY_POWER = 1.5f;
+    static constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    static constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    static constexpr float VALENCE_BOOST_POWER = 0.5f;
+    static constexpr uint32_t VALENCE_TABLE_SIZE = 32;
+    // what analyzeVertexCache and the overdraw clustering simulate
+    static constexpr uint32_t FIFO_CACHE_SIZE = 16;
+    static constexpr uint32_t NO_TRIANGLE = ~0u;
+
+    // a vertex is cached while fewer than cacheSize other vertices were loaded after it,
+    // a fifo without moving anything around
+    class FifoCache {
+    public:
+        FifoCache(size_t vertexCount, uint32_t size) : loadedAt(vertexCount, 0), cacheSize{size} {}
+
+        // true on a miss
+        bool touch(uint32_t vertex) {
+            // loading stamps timestamp and then bumps it, so the vertex itself accounts for the first 1
+            if (timestamp - loadedAt[vertex] <= cacheSize) { return false; }
+            loadedAt[vertex] = timestamp++;
+            return true;
+        }
+        void reset() { timestamp += cacheSize + 1; }
+
+    private:
+        std::vector<uint32_t> loadedAt;
+        uint32_t cacheSize;
+        uint32_t timestamp = cacheSize + 1;
+    };
+
+    VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                        uint32_t cacheSize) {
+        assert(indexCount % 3 == 0 && "Index count must be a multiple of 3");
+        VertexCacheStats stats{};
+        if (indexCount == 0) { return stats; }
+
+        FifoCache cache(vertexCount, cacheSize);
+        std::vector<bool> used(vertexCount, false);
+        size_t misses = 0;
+        size_t uniqueVertices = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            if (cache.touch(indices[i])) { misses++; }
+            if (!used[indices[i]]) {
+                used[indices[i]] = true;
+                uniqueVertices++;
+            }
+        }
+        stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+        stats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+        return stats;
+    }
+
+    class VertexScoreTable {
+    public:
+        VertexScoreTable() {
+            for (uint32_t i = 0; i < SCORE_CACHE_SIZE; i++) {
+                // the last triangle's vertices get a fixed score, so the same triangle is not favoured twice
+                cacheScores[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                    : std::pow(1.0f - static_cast<float>(i - 3) / (SCORE_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+            for (uint32_t i = 0; i < VALENCE_TABLE_SIZE; i++) { valenceScores[i] = valenceScore(i); }
+        }
+
+        float score(int32_t cachePosition, uint32_t remaining) const {
+            // no triangles left, never wanted again
+            if (remaining == 0) { return -1.0f; }
+            float score = cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f;
+            return score + (remaining < VALENCE_TABLE_SIZE ? valenceScores[remaining] : valenceScore(remaining));
+        }
+
+    private:
+        // vertices with few triangles left are finished first so they do not end up as lone triangles
+        static float valenceScore(uint32_t remaining) {
+            return remaining == 0 ? 0.0f
+                : VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining), -VALENCE_BOOST_POWER);
+        }
+
+        float cacheScores[SCORE_CACHE_SIZE];
+        float valenceScores[VALENCE_TABLE_SIZE];
+    };
+
+    void optimizeVertexCache(uint32_t *destination, const uint32_t *indices, size_t indexCount, size_t vertexCount) {
+        assert(indexCount % 3 == 0 && "Index count must be a multiple of 3");
+        assert(destination != indices && "Vertex cache optimization cannot run in place");
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) { return; }
+        static const VertexScoreTable scores{};
+
+        // triangles of every vertex, the live ones are the first remaining[v] of each list
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++) { remaining[indices[i]]++; }
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) { offsets[v + 1] = offsets[v] + remaining[v]; }
+        std::vector<uint32_t> adjacency(indexCount);
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indexCount; i++) {
+                adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        std::vector<int32_t> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) { vertexScores[v] = scores.score(-1, remaining[v]); }
+        std::vector<float> triangleScores(triangleCount);
+        uint32_t best = NO_TRIANGLE;
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+                vertexScores[indices[t * 3 + 2]];
+            if (best == NO_TRIANGLE || triangleScores[t] > triangleScores[best]) { best = static_cast<uint32_t>(t); }
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        uint32_t cache[SCORE_CACHE_SIZE + 3];
+        uint32_t newCache[SCORE_CACHE_SIZE + 3];
+        size_t cacheCount = 0;
+        size_t deadEndCursor = 0;
+
+        for (size_t out = 0; out < triangleCount; out++) {
+            if (best == NO_TRIANGLE) {
+                // nothing left around the cache. Forsyth rescans every triangle here, the next one in input
+                // order is almost as good and keeps the whole pass linear
+                while (emitted[deadEndCursor]) { deadEndCursor++; }
+                best = static_cast<uint32_t>(deadEndCursor);
+            }
+            const uint32_t *triangle = indices + best * 3;
+            std::copy(triangle, triangle + 3, destination + out * 3);
+            emitted[best] = true;
+
+            // the triangle is done, drop it from its vertices
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = triangle[k];
+                uint32_t *list = adjacency.data() + offsets[v];
+                uint32_t *last = list + remaining[v] - 1;
+                *std::find(list, last + 1, best) = *last;
+                remaining[v]--;
+            }
+
+            // its vertices move to the front, everything else shifts back and may fall out
+            size_t newCount = 0;
+            for (int k = 0; k < 3; k++) {
+                if (std::find(newCache, newCache + newCount, triangle[k]) == newCache + newCount) {
+                    newCache[newCount++] = triangle[k];
+                }
+            }
+            for (size_t i = 0; i < cacheCount; i++) {
+                uint32_t v = cache[i];
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2]) { newCache[newCount++] = v; }
+            }
+
+            for (size_t i = 0; i < newCount; i++) {
+                uint32_t v = newCache[i];
+                cachePositions[v] = i < SCORE_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+                float score = scores.score(cachePositions[v], remaining[v]);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+                    triangleScores[adjacency[a]] += delta;
+                }
+            }
+
+            // only triangles touching the cache changed, the best one is among them or it is a dead end
+            cacheCount = std::min<size_t>(newCount, SCORE_CACHE_SIZE);
+            std::copy(newCache, newCache + cacheCount, cache);
+            best = NO_TRIANGLE;
+            float bestScore = 0.0f;
+            for (size_t i = 0; i < cacheCount; i++) {
+                uint32_t v = cache[i];
+                for (uint32_t a = offsets[v]; a < offsets[v] + remaining[v]; a++) {
+                    uint32_t t = adjacency[a];
+                    if (best == NO_TRIANGLE || triangleScores[t] > bestScore) {
+                        best = t;
+                        bestScore = triangleScores[t];
+                    }
+                }
+            }
+        }
+    }
+
+    void optimizeOverdraw(uint32_t *destination, const uint32_t *indices, size_t indexCount, const float *positions,
+                          size_t vertexCount, size_t positionStride, float threshold) {
+        assert(indexCount % 3 == 0 && "Index count must be a multiple of 3");
+        assert(destination != indices && "Overdraw optimization cannot run in place");
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) { return; }
+
+        // hard borders where the optimized order starts over with three misses, nothing is lost cutting there
+        FifoCache cache(vertexCount, FIFO_CACHE_SIZE);
+        std::vector<uint32_t> hardClusters;
+        for (size_t t = 0; t < triangleCount; t++) {
+            int misses = cache.touch(indices[t * 3]) + cache.touch(indices[t * 3 + 1]) +
+                cache.touch(indices[t * 3 + 2]);
+            if (t == 0 || misses == 3) { hardClusters.push_back(static_cast<uint32_t>(t)); }
+        }
+        hardClusters.push_back(static_cast<uint32_t>(triangleCount));
+
+        // soft borders inside them, wherever the acmr so far is already within threshold of the whole cluster
+        std::vector<uint32_t> clusters;
+        for (size_t c = 0; c + 1 < hardClusters.size(); c++) {
+            uint32_t begin = hardClusters[c];
+            uint32_t end = hardClusters[c + 1];
+            cache.reset();
+            size_t clusterMisses = 0;
+            for (uint32_t t = begin; t < end; t++) {
+                clusterMisses += cache.touch(indices[t * 3]) + cache.touch(indices[t * 3 + 1]) +
+                    cache.touch(indices[t * 3 + 2]);
+            }
+            float limit = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+
+            cache.reset();
+            clusters.push_back(begin);
+            size_t misses = 0;
+            uint32_t start = begin;
+            for (uint32_t t = begin; t < end; t++) {
+                misses += cache.touch(indices[t * 3]) + cache.touch(indices[t * 3 + 1]) +
+                    cache.touch(indices[t * 3 + 2]);
+                if (t + 1 < end && static_cast<float>(misses) / static_cast<float>(t + 1 - start) <= limit) {
+                    clusters.push_back(t + 1);
+                    cache.reset();
+                    misses = 0;
+                    start = t + 1;
+                }
+            }
+        }
+        clusters.push_back(static_cast<uint32_t>(triangleCount));
+        size_t clusterCount = clusters.size() - 1;
+
+        auto position = [positions, positionStride](uint32_t v) {
+            auto p = reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + v * positionStride);
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+
+        // area weighted centroids and normals, per cluster and for the whole mesh
+        std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+        std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+        std::vector<float> areas(clusterCount, 0.0f);
+        glm::vec3 meshCentroid{0.0f};
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; c++) {
+            for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                glm::vec3 a = position(indices[t * 3]);
+                glm::vec3 b = position(indices[t * 3 + 1]);
+                glm::vec3 d = position(indices[t * 3 + 2]);
+                glm::vec3 normal = glm::cross(b - a, d - a);
+                float area = glm::length(normal);
+                centroids[c] += (a + b + d) * (area / 3.0f);
+                normals[c] += normal;
+                areas[c] += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += areas[c];
+        }
+        if (meshArea > 0.0f) { meshCentroid /= meshArea; }
+
+        std::vector<float> sortKeys(clusterCount, 0.0f);
+        for (size_t c = 0; c < clusterCount; c++) {
+            float normalLength = glm::length(normals[c]);
+            if (areas[c] <= 0.0f || normalLength <= 0.0f) { continue; }
+            sortKeys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+        }
+
+        std::vector<uint32_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) { order[c] = static_cast<uint32_t>(c); }
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) {
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        size_t out = 0;
+        for (uint32_t c : order) {
+            size_t count = (clusters[c + 1] - clusters[c]) * 3;
+            std::copy(indices + clusters[c] * 3, indices + clusters[c] * 3 + count, destination + out);
+            out += count;
+        }
+    }
+
+    size_t optimizeVertexFetchRemap(uint32_t *remap, const uint32_t *indices, size_t indexCount, size_t vertexCount) {
+        std::fill(remap, remap + vertexCount, ~0u);
+        uint32_t next = 0;
+        for (size_t i = 0; i < indexCount; i++) {
+            uint32_t &target = remap[indices[i]];
+            if (target == ~0u) { target = next++; }
+        }
+        return next;
+    }
+}
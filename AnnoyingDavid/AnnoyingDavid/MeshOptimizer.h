@@ -0,0 +1,31 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace svk {
+    // transformed vertices per triangle and per unique vertex, for a fifo post transform cache.
+    // 0.5 acmr is the best a regular grid can do, 1.0 atvr means every vertex is shaded once
+    struct VertexCacheStats {
+        float acmr = 0.0f;
+        float atvr = 0.0f;
+    };
+
+    VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                        uint32_t cacheSize = 16);
+
+    // Forsyth's linear speed vertex cache optimization. Triangles are emitted greedily by the scores of their
+    // vertices, which favour vertices still in the simulated cache and vertices with few triangles left.
+    // destination must not alias indices
+    void optimizeVertexCache(uint32_t *destination, const uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+    // Run after optimizeVertexCache. Cuts the triangles into clusters where the cache starts over and sorts the
+    // clusters so the ones facing away from the mesh center come first, they tend to occlude the rest.
+    // Clusters keep their triangle order, threshold bounds how much worse the acmr may get (1.05 = 5%).
+    // positions are read with positionStride bytes between vertices. destination must not alias indices
+    void optimizeOverdraw(uint32_t *destination, const uint32_t *indices, size_t indexCount, const float *positions,
+                          size_t vertexCount, size_t positionStride, float threshold = 1.05f);
+
+    // Orders vertices by first use in the index buffer so fetches walk the vertex buffer front to back.
+    // remap gets the new index of every vertex, ~0u for unused ones. returns the number of used vertices
+    size_t optimizeVertexFetchRemap(uint32_t *remap, const uint32_t *indices, size_t indexCount, size_t vertexCount);
+}
@@ -1,28 +1,183 @@
 ﻿#include "Model.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION   
-#include "tiny_obj_loader.h"
-
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
-
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
 #include "Renderer.h"
 
-namespace std {
-    template <>
-    struct hash<svk::Model::Vertex> {
-        size_t operator()(const svk::Model::Vertex& vertex) const {
-            size_t seed = 0;
-            svk::hashCombine(seed, vertex.pos, vertex.color, vertex.normal, vertex.texCoord);
-            return seed;
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+
+namespace svk {
+    // vertex and index streams follow the header back to back, both read in place from the mapping
+    struct MeshCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+        uint32_t vertexStride;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        Model::VertexFormat vertexFormat;
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        glm::vec4 boundingSphere;
+    };
+
+    static constexpr uint32_t MESH_CACHE_MAGIC = 0x4d4b5653; // "SVKM"
+    // bump whenever the vertex layout or the way meshes are built changes
+    static constexpr uint32_t MESH_CACHE_VERSION = 4;
+
+    static uint32_t vertexSize(Model::VertexFormat format) {
+        return format == Model::VertexFormat::Packed ? sizeof(Model::PackedVertex) : sizeof(Model::Vertex);
+    }
+
+    // unit vector onto the octahedron, the lower half folded over the diagonals, both components in [-1, 1]
+    static glm::vec2 octEncode(glm::vec3 n) {
+        float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (length == 0.0f) { return glm::vec2{0.0f}; }
+        n /= length;
+        glm::vec2 p{n.x, n.y};
+        if (n.z < 0.0f) {
+            p = glm::vec2{
+                (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)
+            };
+        }
+        return p;
+    }
+
+    // Open addressing table from an obj index triple to the vertex built for it. Corners that share the
+    // triple share the vertex, so the floats never have to be hashed or compared. Linear probing, never shrinks.
+    class CornerTable {
+    public:
+        explicit CornerTable(size_t cornerCount) {
+            // at most half full, every corner could be unique
+            size_t capacity = 16;
+            while (capacity < cornerCount * 2) { capacity *= 2; }
+            slots.resize(capacity);
+            mask = capacity - 1;
         }
+
+        // the vertex of this corner, nextVertex is stored when the triple is new
+        uint32_t findOrInsert(const ObjIndex& index, uint32_t nextVertex, bool& inserted) {
+            for (size_t i = hash(index) & mask;; i = (i + 1) & mask) {
+                Slot& slot = slots[i];
+                if (slot.vertex == EMPTY) {
+                    slot = {index.position, index.normal, index.texCoord, nextVertex};
+                    inserted = true;
+                    return nextVertex;
+                }
+                if (slot.position == index.position && slot.normal == index.normal &&
+                    slot.texCoord == index.texCoord) {
+                    inserted = false;
+                    return slot.vertex;
+                }
+            }
+        }
+
+    private:
+        static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+        struct Slot {
+            int position;
+            int normal;
+            int texCoord;
+            uint32_t vertex = EMPTY;
+        };
+
+        static size_t hash(const ObjIndex& index) {
+            uint64_t h = static_cast<uint32_t>(index.position) * 0x9e3779b97f4a7c15ull;
+            h ^= static_cast<uint32_t>(index.normal) * 0xc2b2ae3d27d4eb4full;
+            h ^= static_cast<uint32_t>(index.texCoord) * 0x165667b19e3779f9ull;
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+
+        std::vector<Slot> slots;
+        size_t mask = 0;
     };
-}
 
-namespace svk {
+    // the parser checked every index against the array sizes
+    static Model::Vertex objVertex(const ObjData& obj, const ObjIndex& index) {
+        Model::Vertex vertex{};
+        vertex.pos = {
+            obj.positions[3 * index.position + 0],
+            obj.positions[3 * index.position + 1],
+            obj.positions[3 * index.position + 2]
+        };
+        if (index.normal >= 0) {
+            vertex.normal = {
+                obj.normals[3 * index.normal + 0],
+                obj.normals[3 * index.normal + 1],
+                obj.normals[3 * index.normal + 2]
+            };
+        }
+        if (index.texCoord >= 0) {
+            vertex.texCoord = {
+                obj.texCoords[2 * index.texCoord + 0],
+                1.0f - obj.texCoords[2 * index.texCoord + 1]
+            };
+        }
+        vertex.color = {1.0f, 1.0f, 1.0f};
+        return vertex;
+    }
+
+    static std::optional<Model::MeshData> readMeshCache(const MappedFile& cache, const MappedFile& source,
+                                                        uint64_t sourceHash, Model::VertexFormat format,
+                                                        const char*& reason) {
+        MeshCacheHeader header{};
+        if (!cache.isOpen()) {
+            reason = "no cache";
+            return std::nullopt;
+        }
+        if (cache.size() < sizeof(header)) {
+            reason = "file too small";
+            return std::nullopt;
+        }
+        std::memcpy(&header, cache.data(), sizeof(header));
+        if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+            header.vertexFormat != format || header.vertexStride != vertexSize(format)) {
+            reason = "unknown file format";
+            return std::nullopt;
+        }
+        if (header.sourceSize != source.size() || header.sourceHash != sourceHash) {
+            reason = "source changed";
+            return std::nullopt;
+        }
+        uint64_t vertexBytes = static_cast<uint64_t>(header.vertexCount) * header.vertexStride;
+        uint64_t indexBytes = static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t);
+        if (cache.size() != sizeof(header) + vertexBytes + indexBytes) {
+            reason = "truncated file";
+            return std::nullopt;
+        }
+
+        auto bytes = static_cast<const char*>(cache.data());
+        Model::MeshData mesh{};
+        mesh.vertices = bytes + sizeof(header);
+        mesh.format = format;
+        mesh.vertexCount = header.vertexCount;
+        mesh.indices = header.indexCount > 0
+                           ? reinterpret_cast<const uint32_t*>(bytes + sizeof(header) + vertexBytes)
+                           : nullptr;
+        mesh.indexCount = header.indexCount;
+        mesh.boundsMin = glm::vec3(header.boundsMin);
+        mesh.boundsMax = glm::vec3(header.boundsMax);
+        mesh.boundingSphere = header.boundingSphere;
+        return mesh;
+    }
+
     std::vector<VkVertexInputBindingDescription> Model::Vertex::getBindingDescriptions() {
         std::vector<VkVertexInputBindingDescription> bindingDescription(1);
         bindingDescription[0].binding = 0;
@@ -40,23 +195,85 @@ namespace svk {
         return attributeDescriptions;
     }
 
-    Model::Model(Device& dev, const Builder& builder)
-        : device(dev) {
-        createVertexBuffers(builder.vertices);
-        createIndexBuffers(builder.indices);
+    std::vector<VkVertexInputBindingDescription> Model::PackedVertex::getBindingDescriptions() {
+        std::vector<VkVertexInputBindingDescription> bindingDescription(1);
+        bindingDescription[0].binding = 0;
+        bindingDescription[0].stride = sizeof(PackedVertex);
+        bindingDescription[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescription;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> Model::PackedVertex::getAttributeDescriptions() {
+        // same locations as Vertex minus the color
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+        attributeDescriptions.push_back({0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, position)});
+        attributeDescriptions.push_back({2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, texCoord)});
+        attributeDescriptions.push_back({3, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)});
+        return attributeDescriptions;
+    }
+
+    Model::Model(Device& dev, const Builder& builder) : Model(dev, builder.meshData()) {}
+
+    Model::Model(Device& dev, const MeshData& mesh)
+        : device(dev), vertexFormat(mesh.format), boundingSphere(mesh.boundingSphere), boundsMin(mesh.boundsMin),
+          boundsMax(mesh.boundsMax) {
+        createVertexBuffers(mesh.vertices, mesh.vertexCount, vertexSize(mesh.format));
+        createIndexBuffers(mesh.indices, mesh.indexCount);
     }
 
     Model::~Model() {}
 
-    std::unique_ptr<Model> Model::createModelFromFile(Device& device, const std::string& filepath) {
+    std::unique_ptr<Model> Model::createModelFromFile(Device& device, const std::string& filepath,
+                                                      JobSystem& jobSystem, VertexFormat format) {
+        auto start = std::chrono::high_resolution_clock::now();
+        MappedFile source(filepath);
+        if (!source.isOpen()) { throw std::runtime_error("failed to open model file: " + filepath); }
+        uint64_t sourceHash = fnv1a(source.data(), source.size());
+        std::string cachePath = filepath + (format == VertexFormat::Packed ? ".packed" : "") + MESH_CACHE_EXTENSION;
+
+        const char* reason = nullptr;
+        {
+            // the streams go from the mapping straight into staging, no vertex vectors in between
+            MappedFile cache(cachePath);
+            if (auto mesh = readMeshCache(cache, source, sourceHash, format, reason)) {
+                auto model = std::make_unique<Model>(device, *mesh);
+#ifndef NDEBUG
+                double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+                printf("mesh cache: %s mapped in %.2f ms\n", cachePath.c_str(), ms);
+#endif
+                return model;
+            }
+        }
+
+#ifndef NDEBUG
+        printf("mesh cache: %s for %s, parsing the obj\n", reason, filepath.c_str());
+#endif
         Builder builder;
-        builder.loadModel(filepath);
-        return std::make_unique<Model>(device, builder);
+        builder.loadModel(filepath, jobSystem);
+        if (format == VertexFormat::Packed) { builder.pack(); }
+        builder.writeMeshCache(cachePath, sourceHash, source.size(), format);
+        return std::make_unique<Model>(device, builder.meshData(format));
     }
 
-    void Model::draw(VkCommandBuffer commandBuffer) {
-        if (hasIndexBuffer) { vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0); }
-        else { vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0); }
+    void Model::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
+        if (hasIndexBuffer) { vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, firstInstance); }
+        else { vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance); }
+    }
+
+    void Model::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer drawBuffer, VkDeviceSize offset,
+                             VkBuffer countBuffer, VkDeviceSize countOffset) {
+        // the slot is sized for VkDrawIndexedIndirectCommand either way
+        constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        if (countBuffer != VK_NULL_HANDLE) {
+            if (hasIndexBuffer) {
+                vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, offset, countBuffer, countOffset, 1, stride);
+            }
+            else { vkCmdDrawIndirectCount(commandBuffer, drawBuffer, offset, countBuffer, countOffset, 1, stride); }
+            return;
+        }
+        if (hasIndexBuffer) { vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, offset, 1, stride); }
+        else { vkCmdDrawIndirect(commandBuffer, drawBuffer, offset, 1, stride); }
     }
 
     void Model::bind(VkCommandBuffer commandBuffer) {
@@ -66,95 +283,267 @@ namespace svk {
         if (hasIndexBuffer) { vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32); }
     }
 
-    void Model::createVertexBuffers(const std::vector<Vertex>& vertices) {
-        vertexCount = static_cast<uint32_t>(vertices.size());
+    void Model::createVertexBuffers(const void* vertices, uint32_t count, uint32_t vertexSize) {
+        vertexCount = count;
         assert(vertexCount >= 3 && "Vertex must be at least 3");
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-        uint32_t vertexSize = sizeof(vertices[0]);
-
-        Buffer stagingBuffer{
-            device, vertexSize, vertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        };
-
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer(vertices.data());
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(vertexSize) * vertexCount;
 
         vertexBuffer = std::make_unique<Buffer>(device, vertexSize, vertexCount,
                                                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-        device.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+        uploadTicket = std::max(uploadTicket,
+            device.getUploader().uploadBuffer(vertices, bufferSize, vertexBuffer->getBuffer()));
     }
 
-    void Model::createIndexBuffers(const std::vector<uint32_t>& indices) {
-        indexCount = static_cast<uint32_t>(indices.size());
+    void Model::createIndexBuffers(const uint32_t* indices, uint32_t count) {
+        indexCount = count;
         hasIndexBuffer = indexCount > 0;
 
         if (!hasIndexBuffer) { return; }
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-        uint32_t indexSize = sizeof(indices[0]);
-
-        Buffer stagingBuffer{
-            device, indexSize, indexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        };
-        stagingBuffer.map();
-        stagingBuffer.writeToBuffer(indices.data());
+        VkDeviceSize bufferSize = sizeof(uint32_t) * indexCount;
+        uint32_t indexSize = sizeof(uint32_t);
 
         indexBuffer = std::make_unique<Buffer>(device, indexSize, indexCount,
                                                VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
                                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-        device.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+        uploadTicket = std::max(uploadTicket,
+            device.getUploader().uploadBuffer(indices, bufferSize, indexBuffer->getBuffer()));
     }
     
-    void Model::Builder::loadModel(const std::string& filepath) {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn, err;
-
-        if (!LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
-            throw std::runtime_error(warn + err);
-        }
+    void Model::Builder::loadModel(const std::string& filepath, JobSystem& jobSystem) {
+        auto start = std::chrono::high_resolution_clock::now();
+        MappedFile file(filepath);
+        if (!file.isOpen()) { throw std::runtime_error("failed to open model file: " + filepath); }
+        ObjData obj = parseObj(static_cast<const char*>(file.data()), file.size(), jobSystem);
+        [[maybe_unused]] double parseMs = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
 
         vertices.clear();
         indices.clear();
 
-        std::unordered_map<Vertex, uint32_t, std::hash<Vertex>> uniqueVertices{};
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {
-                Vertex vertex{};
-                if (index.vertex_index >= 0) {
-                    vertex.pos = {
-                        attrib.vertices[3 * index.vertex_index + 0],
-                        attrib.vertices[3 * index.vertex_index + 1],
-                        attrib.vertices[3 * index.vertex_index + 2]
-                    };
-                }
-                if (index.normal_index >= 0) {
-                    vertex.normal = {
-                        attrib.normals[3 * index.normal_index + 0],
-                        attrib.normals[3 * index.normal_index + 1],
-                        attrib.normals[3 * index.normal_index + 2]
-                    };
-                }
-                if (index.texcoord_index >= 0) {
-                    vertex.texCoord = {
-                        attrib.texcoords[2 * index.texcoord_index + 0],
-                        1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-                    };
-                }
-                vertex.color = {1.0f, 1.0f, 1.0f};
-
-                //todo removed the unique vertices due to bugs. no clue why tho
-                //if (uniqueVertices.count(vertex) == 0 && false) {
-                //    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                //    vertices.push_back(vertex); 
-                //}
-                vertices.push_back(vertex);
-                //indices.push_back(index.vertex_index);
+        size_t cornerCount = obj.corners.size();
+        indices.reserve(cornerCount);
+        vertices.reserve(cornerCount);
+
+        CornerTable corners(cornerCount);
+        for (const auto& index : obj.corners) {
+            bool inserted = false;
+            uint32_t vertexIndex = corners.findOrInsert(index, static_cast<uint32_t>(vertices.size()), inserted);
+            indices.push_back(vertexIndex);
+            if (inserted) { vertices.push_back(objVertex(obj, index)); }
+        }
+        [[maybe_unused]] auto [before, after] = optimize();
+        computeBounds();
+
+#ifndef NDEBUG
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        double megabytes = file.size() / (1024.0 * 1024.0);
+        printf("loaded %s: %.2f MB parsed in %.2f ms (%.1f MB/s), %zu corners, %zu unique vertices (%.1f%%), "
+               "%.2f ms total\n", filepath.c_str(), megabytes, parseMs, megabytes / (parseMs / 1000.0), cornerCount,
+               vertices.size(), cornerCount > 0 ? 100.0 * vertices.size() / cornerCount : 0.0, ms);
+        printf("  vertex cache: acmr %.3f -> %.3f, atvr %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr,
+               after.atvr);
+#endif
+    }
+
+    std::pair<VertexCacheStats, VertexCacheStats> Model::Builder::optimize() {
+        if (indices.empty()) { return {}; }
+        VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+        // cache order first, the overdraw pass only moves whole runs of it around
+        std::vector<uint32_t> cacheOrder(indices.size());
+        optimizeVertexCache(cacheOrder.data(), indices.data(), indices.size(), vertices.size());
+        optimizeOverdraw(indices.data(), cacheOrder.data(), cacheOrder.size(), &vertices[0].pos.x, vertices.size(),
+                         sizeof(Vertex));
+
+        std::vector<uint32_t> remap(vertices.size());
+        size_t usedCount = optimizeVertexFetchRemap(remap.data(), indices.data(), indices.size(), vertices.size());
+        std::vector<Vertex> fetchOrder(usedCount);
+        for (size_t v = 0; v < vertices.size(); v++) {
+            if (remap[v] != ~0u) { fetchOrder[remap[v]] = vertices[v]; }
+        }
+        for (auto& index : indices) { index = remap[index]; }
+        vertices = std::move(fetchOrder);
+
+        return {before, analyzeVertexCache(indices.data(), indices.size(), vertices.size())};
+    }
+
+    void Model::Builder::computeBounds() {
+        boundsMin = glm::vec3{std::numeric_limits<float>::max()};
+        boundsMax = glm::vec3{std::numeric_limits<float>::lowest()};
+        for (auto& vertex : vertices) {
+            boundsMin = glm::min(boundsMin, vertex.pos);
+            boundsMax = glm::max(boundsMax, vertex.pos);
+        }
+
+        // centered on the box, not minimal but good enough to cull with
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (auto& vertex : vertices) {
+            glm::vec3 offset = vertex.pos - center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+    }
+
+    void Model::Builder::pack() {
+        // a flat axis keeps a zero extent, every vertex then decodes to boundsMin on it
+        glm::vec3 extent = boundsMax - boundsMin;
+        glm::vec3 invExtent{
+            extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+            extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+            extent.z > 0.0f ? 1.0f / extent.z : 0.0f
+        };
+
+        packedVertices.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            const Vertex& vertex = vertices[i];
+            PackedVertex& packed = packedVertices[i];
+
+            glm::vec3 position = (vertex.pos - boundsMin) * invExtent;
+            for (int axis = 0; axis < 3; axis++) { packed.position[axis] = glm::packUnorm1x16(position[axis]); }
+            packed.position[3] = 0;
+
+            glm::vec2 normal = octEncode(vertex.normal);
+            packed.normal[0] = static_cast<int16_t>(glm::packSnorm1x16(normal.x));
+            packed.normal[1] = static_cast<int16_t>(glm::packSnorm1x16(normal.y));
+
+            packed.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+            packed.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+        }
+    }
+
+    Model::MeshData Model::Builder::meshData(VertexFormat format) const {
+        assert((format == VertexFormat::Full || packedVertices.size() == vertices.size()) &&
+               "Builder must be packed before its packed mesh data is used");
+        MeshData mesh{};
+        mesh.vertices = format == VertexFormat::Packed
+                            ? static_cast<const void*>(packedVertices.data())
+                            : static_cast<const void*>(vertices.data());
+        mesh.format = format;
+        mesh.vertexCount = static_cast<uint32_t>(vertices.size());
+        mesh.indices = indices.empty() ? nullptr : indices.data();
+        mesh.indexCount = static_cast<uint32_t>(indices.size());
+        mesh.boundsMin = boundsMin;
+        mesh.boundsMax = boundsMax;
+        mesh.boundingSphere = boundingSphere;
+        return mesh;
+    }
+
+    void Model::Builder::writeMeshCache(const std::string& cachePath, uint64_t sourceHash, uint64_t sourceSize,
+                                        VertexFormat format) const {
+        MeshData mesh = meshData(format);
+        MeshCacheHeader header{};
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.vertexStride = vertexSize(format);
+        header.vertexFormat = format;
+        header.vertexCount = static_cast<uint32_t>(vertices.size());
+        header.indexCount = static_cast<uint32_t>(indices.size());
+        header.boundsMin = glm::vec4(boundsMin, 0.0f);
+        header.boundsMax = glm::vec4(boundsMax, 0.0f);
+        header.boundingSphere = boundingSphere;
+        header.sourceSize = sourceSize;
+
+        // same as the pipeline cache, a crash mid write never leaves a torn file behind
+        std::string tempPath = cachePath + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(static_cast<const char*>(mesh.vertices),
+                       static_cast<std::streamsize>(mesh.vertexCount) * header.vertexStride);
+            file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+            if (!file) {
+                printf("mesh cache: failed to write %s\n", tempPath.c_str());
+                return;
             }
         }
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+        if (error) { printf("mesh cache: failed to replace %s\n", cachePath.c_str()); }
+    }
+
+    // what the builder hashed before the corner table, every float of the vertex
+    struct VertexHash {
+        size_t operator()(const Model::Vertex& vertex) const {
+            size_t seed = 0;
+            hashCombine(seed, vertex.pos.x, vertex.pos.y, vertex.pos.z, vertex.color.x, vertex.color.y, vertex.color.z,
+                        vertex.texCoord.x, vertex.texCoord.y, vertex.normal.x, vertex.normal.y, vertex.normal.z);
+            return seed;
+        }
+    };
+
+    void benchmarkVertexDedup(const std::string &filepath, int iterations) {
+        MappedFile file(filepath);
+        if (!file.isOpen()) { throw std::runtime_error("failed to open model file: " + filepath); }
+        JobSystem jobSystem{};
+        ObjData obj = parseObj(static_cast<const char *>(file.data()), file.size(), jobSystem);
+        size_t cornerCount = obj.corners.size();
+
+        auto time = [iterations](auto &&build) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; i++) { build(); }
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+        };
+
+        std::vector<Model::Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        double noneMs = time([&] {
+            vertices.clear();
+            indices.clear();
+            vertices.reserve(cornerCount);
+            indices.reserve(cornerCount);
+            for (const auto &index : obj.corners) {
+                indices.push_back(static_cast<uint32_t>(vertices.size()));
+                vertices.push_back(objVertex(obj, index));
+            }
+        });
+        size_t noneVertices = vertices.size();
+
+        double mapMs = time([&] {
+            vertices.clear();
+            indices.clear();
+            vertices.reserve(cornerCount);
+            indices.reserve(cornerCount);
+            std::unordered_map<Model::Vertex, uint32_t, VertexHash> uniqueVertices;
+            uniqueVertices.reserve(cornerCount);
+            for (const auto &index : obj.corners) {
+                Model::Vertex vertex = objVertex(obj, index);
+                auto [it, inserted] = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(vertices.size()));
+                if (inserted) { vertices.push_back(vertex); }
+                indices.push_back(it->second);
+            }
+        });
+        size_t mapVertices = vertices.size();
+
+        double tableMs = time([&] {
+            vertices.clear();
+            indices.clear();
+            vertices.reserve(cornerCount);
+            indices.reserve(cornerCount);
+            CornerTable corners(cornerCount);
+            for (const auto &index : obj.corners) {
+                bool inserted = false;
+                indices.push_back(corners.findOrInsert(index, static_cast<uint32_t>(vertices.size()), inserted));
+                if (inserted) { vertices.push_back(objVertex(obj, index)); }
+            }
+        });
+        size_t tableVertices = vertices.size();
+
+        // every corner has to read its own vertex back through the table's indices
+        bool valid = true;
+        for (size_t i = 0; i < cornerCount && valid; i++) {
+            valid = vertices[indices[i]] == objVertex(obj, obj.corners[i]);
+        }
+
+        printf("vertex dedup: %s, %zu corners, %d iterations\n", filepath.c_str(), cornerCount, iterations);
+        printf("  none:          %zu vertices, %.2f ms\n", noneVertices, noneMs);
+        printf("  unordered_map: %zu vertices, %.2f ms\n", mapVertices, mapMs);
+        printf("  corner table:  %zu vertices, %.2f ms (%.2fx), indices %s\n", tableVertices, tableMs,
+               mapMs / tableMs, valid ? "match" : "DIFFER");
     }
 }
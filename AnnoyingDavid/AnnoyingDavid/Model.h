@@ -1,5 +1,7 @@
 ﻿#pragma once
 #include "Device.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
 #include "Utils.h"
 
 #define GLM_FORCE_RADIANS
@@ -8,12 +10,18 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "Buffer.h"
 
 namespace svk {
     class Model {
     public:
+        enum class VertexFormat : uint32_t {
+            Full, // Vertex
+            Packed, // PackedVertex, positions need the mesh bounds to decode
+        };
+
         struct Vertex {
             glm::vec3 pos;
             glm::vec3 color;
@@ -28,35 +36,106 @@ namespace svk {
             }
         };
 
+        // 16 bytes instead of 44, decoded in shader1.vert built with PACKED_VERTICES.
+        // no color, loadModel only ever writes white and the packed shader does the same
+        struct PackedVertex {
+            uint16_t position[4]; // unorm between boundsMin and boundsMax, w unused
+            int16_t normal[2]; // octahedral, snorm
+            uint16_t texCoord[2]; // half floats
+
+            static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+            static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+        };
+
+        // the streams a model is uploaded from, owned by a Builder or a mapped mesh cache
+        struct MeshData {
+            const void* vertices = nullptr; // Vertex or PackedVertex, see format
+            VertexFormat format = VertexFormat::Full;
+            uint32_t vertexCount = 0;
+            const uint32_t* indices = nullptr;
+            uint32_t indexCount = 0;
+            glm::vec3 boundsMin{0.0f};
+            glm::vec3 boundsMax{0.0f};
+            glm::vec4 boundingSphere{0.0f};
+        };
+
         struct Builder {
             std::vector<Vertex> vertices;
             std::vector<uint32_t> indices;
+            std::vector<PackedVertex> packedVertices; // filled by pack()
 
-            void loadModel(const std::string &filepath);
+            // object space bounds, filled by computeBounds
+            glm::vec3 boundsMin{0.0f};
+            glm::vec3 boundsMax{0.0f};
+            glm::vec4 boundingSphere{0.0f}; // xyz center, w radius
+
+            // parses the obj on the job system's workers
+            void loadModel(const std::string &filepath, JobSystem &jobSystem);
+            void computeBounds();
+            // triangle order for the vertex cache and overdraw, vertex order for fetching.
+            // returns the fifo cache stats before and after
+            std::pair<VertexCacheStats, VertexCacheStats> optimize();
+            // quantizes vertices against the bounds, after computeBounds
+            void pack();
+            MeshData meshData(VertexFormat format = VertexFormat::Full) const;
+            // failing to write only costs the next launch a parse
+            void writeMeshCache(const std::string &cachePath, uint64_t sourceHash, uint64_t sourceSize,
+                VertexFormat format) const;
         };
 
+        // next to the source file, e.g. skull.obj.svkmesh or skull.obj.packed.svkmesh
+        static constexpr const char* MESH_CACHE_EXTENSION = ".svkmesh";
+
         Model(Device& dev, const Builder &builder);
+        // the data is copied into staging before this returns, the streams may go away afterwards
+        Model(Device& dev, const MeshData &mesh);
         ~Model();
 
-        static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string &filepath);
+        // maps the mesh cache when it was built from the same source bytes, parses the obj and rewrites it otherwise
+        static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string &filepath,
+            JobSystem &jobSystem, VertexFormat format = VertexFormat::Full);
         
         Model(const Model&) = delete;
         Model& operator=(const Model&) = delete;
 
         void bind(VkCommandBuffer commandBuffer);
-        void draw(VkCommandBuffer commandBuffer);
+        void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+        // commandBuffer holds one draw at offset, countBuffer (optional) says if it is issued
+        void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer drawBuffer, VkDeviceSize offset,
+            VkBuffer countBuffer = VK_NULL_HANDLE, VkDeviceSize countOffset = 0);
+        // false while the vertex/index data is still streaming in
+        bool isReady() const { return device.getUploader().isReady(uploadTicket); }
+
+        bool hasIndices() const { return hasIndexBuffer; }
+        uint32_t getVertexCount() const { return vertexCount; }
+        uint32_t getIndexCount() const { return indexCount; }
+        VertexFormat getVertexFormat() const { return vertexFormat; }
+        // object space, xyz center w radius
+        glm::vec4 getBoundingSphere() const { return boundingSphere; }
+        glm::vec3 getBoundsMin() const { return boundsMin; }
+        glm::vec3 getBoundsMax() const { return boundsMax; }
 
     private:
-        void createVertexBuffers(const std::vector<Vertex>& vertices);
-        void createIndexBuffers(const std::vector<uint32_t>& indices);
+        void createVertexBuffers(const void* vertices, uint32_t count, uint32_t vertexSize);
+        void createIndexBuffers(const uint32_t* indices, uint32_t count);
 
         Device& device;
         
         std::unique_ptr<Buffer> vertexBuffer;
         uint32_t vertexCount{};
+        VertexFormat vertexFormat = VertexFormat::Full;
 
         bool hasIndexBuffer = false;
         std::unique_ptr<Buffer> indexBuffer;
         uint32_t indexCount{};
+
+        uint64_t uploadTicket = 0;
+        glm::vec4 boundingSphere{0.0f};
+        glm::vec3 boundsMin{0.0f};
+        glm::vec3 boundsMax{0.0f};
     };
+
+    // times building the vertex and index streams from one parsed obj with no dedup, a hash map keyed by the
+    // vertex and the corner table keyed by the index triple, and prints the vertex count of each
+    void benchmarkVertexDedup(const std::string &filepath, int iterations);
 }
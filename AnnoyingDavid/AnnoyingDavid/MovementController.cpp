@@ -31,27 +31,34 @@ void svk::MovementController::update(float dt, GameObj& gameObject) {
     if (isDown(keys.lookUp)) rotate.x += 1.f;
     if (isDown(keys.lookDown)) rotate.x -= 1.f;
 
+    // transform() marks the object dirty, only touch it when something actually moves
     if (glm::dot(rotate, rotate) > std::numeric_limits<float>::epsilon()) {
-        gameObject.transform.rotation += lookSpeed * dt * glm::normalize(rotate);
+        auto& transform = gameObject.transform();
+        transform.rotation += lookSpeed * dt * glm::normalize(rotate);
+        transform.rotation.x = glm::clamp(transform.rotation.x, -1.5f, 1.5f);
+        transform.rotation.y = glm::mod(transform.rotation.y, glm::two_pi<float>());
     }
-    
-    gameObject.transform.rotation.x = glm::clamp(gameObject.transform.rotation.x, -1.5f, 1.5f);
-    gameObject.transform.rotation.y = glm::mod(gameObject.transform.rotation.y, glm::two_pi<float>());
 
-    float yaw = gameObject.transform.rotation.y;
+    // forward, right and up in the camera's yaw frame
+    glm::vec3 move{0.f};
+    if (isDown(keys.moveForward)) move.z += 1.f;
+    if (isDown(keys.moveBackward)) move.z -= 1.f;
+    if (isDown(keys.moveRight)) move.x += 1.f;
+    if (isDown(keys.moveLeft)) move.x -= 1.f;
+    if (isDown(keys.moveUp)) move.y += 1.f;
+    if (isDown(keys.moveDown)) move.y -= 1.f;
+    if (glm::dot(move, move) <= std::numeric_limits<float>::epsilon()) {
+        return;
+    }
+
+    auto& transform = gameObject.transform();
+    float yaw = transform.rotation.y;
     const glm::vec3 forwardDir{sin(yaw), 0.f, cos(yaw)};
     const glm::vec3 rightDir{forwardDir.z, 0.f, -forwardDir.x};
     const glm::vec3 upDir{0.f, -1.f, 0.f};
 
-    glm::vec3 moveDir{0.f};
-    if (isDown(keys.moveForward)) moveDir += forwardDir;
-    if (isDown(keys.moveBackward)) moveDir -= forwardDir;
-    if (isDown(keys.moveRight)) moveDir += rightDir;
-    if (isDown(keys.moveLeft)) moveDir -= rightDir;
-    if (isDown(keys.moveUp)) moveDir += upDir;
-    if (isDown(keys.moveDown)) moveDir -= upDir;
-
+    glm::vec3 moveDir = move.z * forwardDir + move.x * rightDir + move.y * upDir;
     if (glm::dot(moveDir, moveDir) > std::numeric_limits<float>::epsilon()) {
-        gameObject.transform.translation += moveSpeed * dt * glm::normalize(moveDir);
+        transform.translation += moveSpeed * dt * glm::normalize(moveDir);
     }
 }
@@ -0,0 +1,276 @@
+﻿#include "ObjLoader.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "MappedFile.h"
+
+namespace svk {
+    // small enough that a model of a few MB still spreads over every worker
+    static constexpr size_t CHUNK_BYTES = 256 * 1024;
+
+    // the parse result of one chunk. negative obj indices count back from the vertices seen so far,
+    // they are stored relative to the chunk and rebased once the counts of all earlier chunks are known
+    struct ObjChunk {
+        const char *begin = nullptr;
+        const char *end = nullptr;
+        std::vector<float> positions;
+        std::vector<float> normals;
+        std::vector<float> texCoords;
+        std::vector<ObjIndex> corners;
+        std::vector<uint8_t> relative; // per corner, RELATIVE_* bits
+        std::string error;
+    };
+
+    static constexpr uint8_t RELATIVE_POSITION = 1 << 0;
+    static constexpr uint8_t RELATIVE_NORMAL = 1 << 1;
+    static constexpr uint8_t RELATIVE_TEX_COORD = 1 << 2;
+
+    static const char *skipBlanks(const char *p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t')) { p++; }
+        return p;
+    }
+
+    static bool parseFloats(const char *p, const char *end, float *out, int count) {
+        for (int i = 0; i < count; i++) {
+            p = skipBlanks(p, end);
+            if (p < end && *p == '+') { p++; }
+            auto result = std::from_chars(p, end, out[i]);
+            if (result.ec != std::errc{}) { return false; }
+            p = result.ptr;
+        }
+        return true;
+    }
+
+    // one component of a face corner. 0 based, either absolute or relative to the chunk
+    static bool parseIndex(const char *&p, const char *end, int32_t localCount, int32_t &index, bool &relative) {
+        int32_t value = 0;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc{} || value == 0) { return false; }
+        p = result.ptr;
+        relative = value < 0;
+        index = relative ? localCount + value : value - 1;
+        return true;
+    }
+
+    static bool parseCorner(const char *&p, const char *end, const ObjChunk &chunk, ObjIndex &corner,
+                            uint8_t &relative) {
+        bool isRelative = false;
+        corner = {-1, -1, -1};
+        relative = 0;
+        if (!parseIndex(p, end, static_cast<int32_t>(chunk.positions.size() / 3), corner.position, isRelative)) {
+            return false;
+        }
+        if (isRelative) { relative |= RELATIVE_POSITION; }
+        if (p == end || *p != '/') { return true; }
+        p++;
+        if (p < end && *p != '/') {
+            if (!parseIndex(p, end, static_cast<int32_t>(chunk.texCoords.size() / 2), corner.texCoord, isRelative)) {
+                return false;
+            }
+            if (isRelative) { relative |= RELATIVE_TEX_COORD; }
+        }
+        if (p == end || *p != '/') { return true; }
+        p++;
+        if (!parseIndex(p, end, static_cast<int32_t>(chunk.normals.size() / 3), corner.normal, isRelative)) {
+            return false;
+        }
+        if (isRelative) { relative |= RELATIVE_NORMAL; }
+        return true;
+    }
+
+    static bool parseFace(const char *p, const char *end, ObjChunk &chunk) {
+        ObjIndex first{}, previous{};
+        uint8_t firstRelative = 0, previousRelative = 0;
+        int count = 0;
+        while (true) {
+            p = skipBlanks(p, end);
+            if (p == end) { break; }
+            ObjIndex corner{};
+            uint8_t relative = 0;
+            if (!parseCorner(p, end, chunk, corner, relative)) { return false; }
+            // fan around the first corner, same as tinyobjloader's triangulation
+            if (count == 0) {
+                first = corner;
+                firstRelative = relative;
+            }
+            else if (count >= 2) {
+                chunk.corners.insert(chunk.corners.end(), {first, previous, corner});
+                chunk.relative.insert(chunk.relative.end(), {firstRelative, previousRelative, relative});
+            }
+            previous = corner;
+            previousRelative = relative;
+            count++;
+        }
+        // points and lines add no triangles
+        return true;
+    }
+
+    static void parseChunk(ObjChunk &chunk) {
+        const char *p = chunk.begin;
+        while (p < chunk.end) {
+            auto lineEnd = static_cast<const char *>(std::memchr(p, '\n', chunk.end - p));
+            if (lineEnd == nullptr) { lineEnd = chunk.end; }
+            const char *end = lineEnd;
+            if (end > p && end[-1] == '\r') { end--; }
+            const char *line = skipBlanks(p, end);
+            p = lineEnd + 1;
+
+            size_t length = end - line;
+            bool ok = true;
+            if (length >= 2 && line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+                float xyz[3];
+                ok = parseFloats(line + 2, end, xyz, 3);
+                chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+            }
+            else if (length >= 3 && line[0] == 'v' && line[1] == 'n' && (line[2] == ' ' || line[2] == '\t')) {
+                float xyz[3];
+                ok = parseFloats(line + 3, end, xyz, 3);
+                chunk.normals.insert(chunk.normals.end(), xyz, xyz + 3);
+            }
+            else if (length >= 3 && line[0] == 'v' && line[1] == 't' && (line[2] == ' ' || line[2] == '\t')) {
+                // an optional third coordinate is ignored
+                float uv[2];
+                ok = parseFloats(line + 3, end, uv, 2);
+                chunk.texCoords.insert(chunk.texCoords.end(), uv, uv + 2);
+            }
+            else if (length >= 2 && line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+                ok = parseFace(line + 2, end, chunk);
+            }
+            if (!ok) {
+                chunk.error = "malformed line: " + std::string(line, std::min<size_t>(length, 64));
+                return;
+            }
+        }
+    }
+
+    ObjData parseObj(const char *text, size_t size, JobSystem &jobSystem) {
+        // chunk borders move forward to the next line start, a chunk can end up empty but never splits a line
+        size_t chunkCount = std::max<size_t>((size + CHUNK_BYTES - 1) / CHUNK_BYTES, 1);
+        std::vector<ObjChunk> chunks(chunkCount);
+        const char *textEnd = text + size;
+        for (size_t i = 0; i < chunkCount; i++) {
+            const char *begin = i == 0 ? text : chunks[i - 1].end;
+            const char *end = textEnd;
+            if (i + 1 < chunkCount) {
+                end = std::max(begin, text + (i + 1) * CHUNK_BYTES);
+                auto newline = static_cast<const char *>(std::memchr(end, '\n', textEnd - end));
+                end = newline != nullptr ? newline + 1 : textEnd;
+            }
+            chunks[i].begin = begin;
+            chunks[i].end = end;
+        }
+
+        jobSystem.parallelFor(chunkCount, 1, [&chunks](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) { parseChunk(chunks[i]); }
+        });
+        for (auto &chunk : chunks) {
+            if (!chunk.error.empty()) { throw std::runtime_error("failed to parse obj, " + chunk.error); }
+        }
+
+        // where every chunk's data lands in the merged arrays
+        struct ChunkBase {
+            size_t positions, normals, texCoords, corners;
+        };
+        std::vector<ChunkBase> bases(chunkCount);
+        ChunkBase total{};
+        for (size_t i = 0; i < chunkCount; i++) {
+            bases[i] = total;
+            total.positions += chunks[i].positions.size();
+            total.normals += chunks[i].normals.size();
+            total.texCoords += chunks[i].texCoords.size();
+            total.corners += chunks[i].corners.size();
+        }
+
+        ObjData data{};
+        data.positions.resize(total.positions);
+        data.normals.resize(total.normals);
+        data.texCoords.resize(total.texCoords);
+        data.corners.resize(total.corners);
+        auto positionCount = static_cast<int32_t>(total.positions / 3);
+        auto normalCount = static_cast<int32_t>(total.normals / 3);
+        auto texCoordCount = static_cast<int32_t>(total.texCoords / 2);
+
+        jobSystem.parallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                auto &chunk = chunks[i];
+                auto &base = bases[i];
+                std::copy(chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + base.positions);
+                std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + base.normals);
+                std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), data.texCoords.begin() + base.texCoords);
+
+                auto positionBase = static_cast<int32_t>(base.positions / 3);
+                auto normalBase = static_cast<int32_t>(base.normals / 3);
+                auto texCoordBase = static_cast<int32_t>(base.texCoords / 2);
+                for (size_t c = 0; c < chunk.corners.size(); c++) {
+                    ObjIndex corner = chunk.corners[c];
+                    uint8_t relative = chunk.relative[c];
+                    if (relative & RELATIVE_POSITION) { corner.position += positionBase; }
+                    if (relative & RELATIVE_NORMAL) { corner.normal += normalBase; }
+                    if (relative & RELATIVE_TEX_COORD) { corner.texCoord += texCoordBase; }
+                    // -1 is only left for components the face omitted, a relative index must not rebase onto it
+                    int32_t minNormal = (relative & RELATIVE_NORMAL) ? 0 : -1;
+                    int32_t minTexCoord = (relative & RELATIVE_TEX_COORD) ? 0 : -1;
+                    if (corner.position < 0 || corner.position >= positionCount || corner.normal < minNormal ||
+                        corner.normal >= normalCount || corner.texCoord < minTexCoord ||
+                        corner.texCoord >= texCoordCount) {
+                        chunk.error = "face index out of range";
+                        break;
+                    }
+                    data.corners[base.corners + c] = corner;
+                }
+            }
+        });
+        for (auto &chunk : chunks) {
+            if (!chunk.error.empty()) { throw std::runtime_error("failed to parse obj, " + chunk.error); }
+        }
+        return data;
+    }
+
+    void benchmarkObjParsing(const std::string &filepath, int iterations) {
+        MappedFile file(filepath);
+        if (!file.isOpen()) { throw std::runtime_error("failed to open model file: " + filepath); }
+        double megabytes = file.size() / (1024.0 * 1024.0);
+        JobSystem jobSystem{};
+
+        auto time = [iterations](auto &&parse) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; i++) { parse(); }
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+        };
+
+        tinyobj::attrib_t attrib;
+        size_t tinyCorners = 0;
+        double tinyMs = time([&] {
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            std::string warn, err;
+            if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
+                throw std::runtime_error(warn + err);
+            }
+            tinyCorners = 0;
+            for (auto &shape : shapes) { tinyCorners += shape.mesh.indices.size(); }
+        });
+
+        ObjData data{};
+        double parallelMs = time([&] {
+            data = parseObj(static_cast<const char *>(file.data()), file.size(), jobSystem);
+        });
+
+        bool same = attrib.vertices.size() == data.positions.size() && attrib.normals.size() == data.normals.size() &&
+            attrib.texcoords.size() == data.texCoords.size() && tinyCorners == data.corners.size();
+        printf("obj parsing: %s, %.2f MB, %d iterations, %u workers\n", filepath.c_str(), megabytes, iterations,
+               jobSystem.getWorkerCount());
+        printf("  tinyobjloader: %.2f ms (%.1f MB/s)\n", tinyMs, megabytes / (tinyMs / 1000.0));
+        printf("  parseObj:      %.2f ms (%.1f MB/s, %.2fx)\n", parallelMs, megabytes / (parallelMs / 1000.0),
+               tinyMs / parallelMs);
+        printf("  %zu corners, results %s\n", data.corners.size(), same ? "match" : "DIFFER");
+    }
+}
@@ -0,0 +1,31 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+
+namespace svk {
+    // 0 based into the arrays of ObjData, -1 when the corner has none
+    struct ObjIndex {
+        int32_t position;
+        int32_t normal;
+        int32_t texCoord;
+    };
+
+    struct ObjData {
+        std::vector<float> positions; // xyz
+        std::vector<float> normals; // xyz
+        std::vector<float> texCoords; // uv
+        std::vector<ObjIndex> corners; // three per triangle, polygons are fanned
+    };
+
+    // Parses the geometry of a wavefront obj (v, vn, vt and f), everything else is skipped. The text is split
+    // into line aligned chunks that are parsed side by side into their own arrays and merged in file order,
+    // so the result is the same as one pass over the file. Throws on malformed lines and bad indices.
+    ObjData parseObj(const char *text, size_t size, JobSystem &jobSystem);
+
+    // times tinyobjloader against parseObj on one file and prints the throughput of both
+    void benchmarkObjParsing(const std::string &filepath, int iterations);
+}
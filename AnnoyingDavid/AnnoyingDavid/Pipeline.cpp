@@ -1,5 +1,6 @@
 ﻿#include "Pipeline.h"
 
+#include <chrono>
 #include <fstream>
 #include <vulkan/vulkan_core.h>
 
@@ -39,6 +40,13 @@ namespace svk {
         createShaderModule(vertShaderCode, &vertShaderModule);
         createShaderModule(fragShaderCode, &fragShaderModule);
 
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.specializationEntries.size());
+        specializationInfo.pMapEntries = configInfo.specializationEntries.data();
+        specializationInfo.dataSize = configInfo.specializationData.size();
+        specializationInfo.pData = configInfo.specializationData.data();
+        auto* specialization = configInfo.specializationEntries.empty() ? nullptr : &specializationInfo;
+
         VkPipelineShaderStageCreateInfo shaderStages[2];
         shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -46,14 +54,14 @@ namespace svk {
         shaderStages[0].pName = "main";
         shaderStages[0].flags = 0;
         shaderStages[0].pNext = nullptr;
-        shaderStages[0].pSpecializationInfo = nullptr;
+        shaderStages[0].pSpecializationInfo = specialization;
         shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         shaderStages[1].module = fragShaderModule;
         shaderStages[1].pName = "main";
         shaderStages[1].flags = 0;
         shaderStages[1].pNext = nullptr;
-        shaderStages[1].pSpecializationInfo = nullptr;
+        shaderStages[1].pSpecializationInfo = specialization;
         
         auto& bindingDescriptions = configInfo.bindingDescriptions;
         auto& attributeDescriptions = configInfo.attributeDescriptions;
@@ -65,6 +73,13 @@ namespace svk {
         vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
         vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
+        // a copied config still points into the original, so the internal pointers are taken from this one
+        VkPipelineColorBlendStateCreateInfo colorBlending = configInfo.colorBlending;
+        colorBlending.pAttachments = &configInfo.colorBlendAttachment;
+        VkPipelineDynamicStateCreateInfo dynamicStateInfo = configInfo.dynamicStateInfo;
+        dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
+        dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         pipelineInfo.stageCount = 2;
@@ -75,8 +90,8 @@ namespace svk {
         pipelineInfo.pRasterizationState = &configInfo.rasterizer;
         pipelineInfo.pMultisampleState = &configInfo.multisampling;
         pipelineInfo.pDepthStencilState = &configInfo.depthStencil;
-        pipelineInfo.pColorBlendState = &configInfo.colorBlending;
-        pipelineInfo.pDynamicState = &configInfo.dynamicStateInfo;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicStateInfo;
 
         pipelineInfo.layout = configInfo.pipelineLayout;
         pipelineInfo.renderPass = configInfo.renderPass;
@@ -84,10 +99,13 @@ namespace svk {
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
         pipelineInfo.basePipelineIndex = -1;
 
-        if (vkCreateGraphicsPipelines(device.getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo,
+        auto start = std::chrono::high_resolution_clock::now();
+        if (vkCreateGraphicsPipelines(device.getDevice(), device.getPipelineCache(), 1, &pipelineInfo,
                                       nullptr, &graphicsPipeline) != VK_SUCCESS) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
+        device.recordPipelineCreation(std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count());
 
         //vkDestroyShaderModule(device.getDevice(), fragShaderModule, nullptr);
         //vkDestroyShaderModule(device.getDevice(), vertShaderModule, nullptr);
@@ -108,6 +126,46 @@ namespace svk {
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
     }
 
+    ComputePipeline::ComputePipeline(Device& device, const std::string& compFilepath,
+                                     VkPipelineLayout pipelineLayout) : device(device) {
+        auto compShaderCode = Pipeline::readFile(compFilepath);
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = compShaderCode.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t*>(compShaderCode.data());
+        if (vkCreateShaderModule(device.getDevice(), &moduleInfo, nullptr, &compShaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = compShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (vkCreateComputePipelines(device.getDevice(), device.getPipelineCache(), 1, &pipelineInfo,
+                                     nullptr, &computePipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute pipeline!");
+        }
+        device.recordPipelineCreation(std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count());
+    }
+
+    ComputePipeline::~ComputePipeline() {
+        vkDestroyShaderModule(device.getDevice(), compShaderModule, nullptr);
+        vkDestroyPipeline(device.getDevice(), computePipeline, nullptr);
+    }
+
+    void ComputePipeline::bind(VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    }
+
     void Pipeline::defaultPipelineConfigInfor(PipelineConfigInfo& configInfo) {
         configInfo.inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
         configInfo.inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
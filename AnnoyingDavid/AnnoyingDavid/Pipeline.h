@@ -1,10 +1,13 @@
 ﻿#pragma once
+#include <cstring>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "Device.h"
 
 namespace svk {
+    // safe to copy, the pointers between its members are only followed from the config the pipeline is built with
     struct PipelineConfigInfo {
         PipelineConfigInfo() = default;
         std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
@@ -21,6 +24,19 @@ namespace svk {
         VkPipelineLayout pipelineLayout = nullptr;
         VkRenderPass renderPass = nullptr;
         uint32_t subpass = 0;
+        // handed to every stage, ids a stage does not declare are ignored by vulkan
+        std::vector<VkSpecializationMapEntry> specializationEntries{};
+        std::vector<uint8_t> specializationData{};
+
+        // T has to match the size of the shader side type, use VkBool32 for a bool constant
+        template <typename T>
+        void setSpecializationConstant(uint32_t constantId, const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>, "Specialization constants are copied bytewise");
+            auto offset = static_cast<uint32_t>(specializationData.size());
+            specializationData.resize(offset + sizeof(T));
+            std::memcpy(specializationData.data() + offset, &value, sizeof(T));
+            specializationEntries.push_back({constantId, offset, sizeof(T)});
+        }
     };
 
     class Pipeline {
@@ -35,8 +51,8 @@ namespace svk {
         void bind(VkCommandBuffer commandBuffer);
         static void defaultPipelineConfigInfor(PipelineConfigInfo& configInfo);
         static void enableAlphaBlending(PipelineConfigInfo& configInfo);
-    private:
         static std::vector<char> readFile(const std::string& filepath);
+    private:
 
         void createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath,
                                     const PipelineConfigInfo& configInfo);
@@ -49,4 +65,19 @@ namespace svk {
 
     };
 
+    class ComputePipeline {
+    public:
+        ComputePipeline(Device& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout);
+        ~ComputePipeline();
+
+        ComputePipeline(const ComputePipeline&) = delete;
+        ComputePipeline& operator=(const ComputePipeline&) = delete;
+
+        void bind(VkCommandBuffer commandBuffer);
+    private:
+        Device& device;
+        VkPipeline computePipeline{};
+        VkShaderModule compShaderModule{};
+    };
+
 }
@@ -0,0 +1,79 @@
+﻿#include "PipelineLibrary.h"
+
+#include <cstdio>
+
+namespace svk {
+    PipelineLibrary::PipelineLibrary(Device& dev, JobSystem& jobs) : device{dev}, jobSystem{jobs} {}
+
+    PipelineLibrary::~PipelineLibrary() {
+        // jobs still running write into pipelines
+        waitIdle();
+    }
+
+    std::vector<PipelineLibrary::PipelineFuture> PipelineLibrary::compile(std::vector<GraphicsPipelineDesc> descs) {
+        std::vector<PipelineFuture> futures;
+        futures.reserve(descs.size());
+
+        for (auto& desc : descs) {
+            auto promise = std::make_shared<std::promise<Pipeline*>>();
+            PipelineFuture future = promise->get_future().share();
+            futures.push_back(future);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (compiling++ == 0) { busySince = std::chrono::high_resolution_clock::now(); }
+                submitted.push_back(future);
+            }
+
+            // the desc moves into the job, the config is copied and Pipeline fixes up its internal pointers
+            jobSystem.submit([this, promise, desc = std::move(desc)] {
+                std::unique_ptr<Pipeline> pipeline;
+                std::exception_ptr error;
+                try {
+                    pipeline = std::make_unique<Pipeline>(device, desc.vertFilepath, desc.fragFilepath,
+                        desc.configInfo);
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+                Pipeline* result = pipeline.get();
+                finishCompile(std::move(pipeline));
+
+                // last, once the future is ready the library may already be gone
+                if (error) { promise->set_exception(error); }
+                else { promise->set_value(result); }
+            });
+        }
+        return futures;
+    }
+
+    PipelineLibrary::PipelineFuture PipelineLibrary::compile(GraphicsPipelineDesc desc) {
+        std::vector<GraphicsPipelineDesc> descs;
+        descs.push_back(std::move(desc));
+        return compile(std::move(descs))[0];
+    }
+
+    void PipelineLibrary::finishCompile(std::unique_ptr<Pipeline> pipeline) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pipeline) { pipelines.push_back(std::move(pipeline)); }
+        compiledSinceIdle++;
+        if (--compiling > 0) { return; }
+
+#ifndef NDEBUG
+        // wall time from the first request, the device stats add up the time spent in the driver
+        double milliseconds = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - busySince).count();
+        printf("pipeline library: %zu pipelines ready after %.2f ms\n", compiledSinceIdle, milliseconds);
+        device.printPipelineStats();
+#endif
+        compiledSinceIdle = 0;
+    }
+
+    void PipelineLibrary::waitIdle() {
+        std::vector<PipelineFuture> waiting;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            waiting.swap(submitted);
+        }
+        for (auto& future : waiting) { future.wait(); }
+    }
+}
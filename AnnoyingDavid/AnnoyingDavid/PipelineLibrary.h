@@ -0,0 +1,53 @@
+﻿#pragma once
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Pipeline.h"
+
+namespace svk {
+    struct GraphicsPipelineDesc {
+        std::string vertFilepath;
+        std::string fragFilepath;
+        PipelineConfigInfo configInfo;
+    };
+
+    // Compiles pipelines on the job system through the device pipeline cache and owns them afterwards.
+    // compile() returns right away, a future becomes ready once its pipeline can be bound, so systems
+    // only wait for the pipelines they draw with. Must outlive everything holding one of its pipelines.
+    class PipelineLibrary {
+    public:
+        using PipelineFuture = std::shared_future<Pipeline*>;
+
+        PipelineLibrary(Device& dev, JobSystem& jobs);
+        ~PipelineLibrary();
+
+        PipelineLibrary(const PipelineLibrary&) = delete;
+        PipelineLibrary& operator=(const PipelineLibrary&) = delete;
+
+        // one job per pipeline, the futures line up with descs. a failed compile rethrows from get()
+        std::vector<PipelineFuture> compile(std::vector<GraphicsPipelineDesc> descs);
+        PipelineFuture compile(GraphicsPipelineDesc desc);
+
+        // blocks until every compile submitted so far has finished
+        void waitIdle();
+
+    private:
+        void finishCompile(std::unique_ptr<Pipeline> pipeline);
+
+        Device& device;
+        JobSystem& jobSystem;
+
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Pipeline>> pipelines;
+        std::vector<PipelineFuture> submitted;
+        // compiles in flight, timed from the first submit until the last one finishes
+        size_t compiling = 0;
+        size_t compiledSinceIdle = 0;
+        std::chrono::high_resolution_clock::time_point busySince;
+    };
+}
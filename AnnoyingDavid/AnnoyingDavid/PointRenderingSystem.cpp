@@ -1,109 +1,143 @@
 ﻿#include "PointRenderingSystem.h"
 
 #include <algorithm>
-#include <map>
+#include <array>
+#include <bit>
 #include <stdexcept>
 
 #include "FrameInfo.h"
+#include "SwapChain.h"
 
 namespace svk {
 
-    struct PointLightPushConstants {
-        glm::vec4 position{};
-        glm::vec4 color{};
-        float radius;
-    };
+    // lsd radix sort on the upper 32 bits, one byte per pass. stable, so equal keys keep their order.
+    // passes where every key has the same byte are skipped, the result always ends up in keys
+    static void radixSortHigh32(std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch) {
+        scratch.resize(keys.size());
+        for (uint32_t shift = 32; shift < 64; shift += 8) {
+            std::array<size_t, 256> offsets{};
+            for (uint64_t key : keys) { offsets[(key >> shift) & 0xff]++; }
+            if (std::find(offsets.begin(), offsets.end(), keys.size()) != offsets.end()) { continue; }
+
+            size_t sum = 0;
+            for (auto& offset : offsets) {
+                size_t count = offset;
+                offset = sum;
+                sum += count;
+            }
+            for (uint64_t key : keys) { scratch[offsets[(key >> shift) & 0xff]++] = key; }
+            keys.swap(scratch);
+        }
+    }
     
-    PointRenderingSystem::PointRenderingSystem(Device& dev, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout): device(dev) {
+    PointRenderingSystem::PointRenderingSystem(Device& dev, PipelineLibrary& pipelineLibrary, VkRenderPass renderPass,
+        VkDescriptorSetLayout globalSetLayout): device(dev) {
         createPipelineLayout(globalSetLayout);
-        createPipeline(renderPass);
+        createPipeline(pipelineLibrary, renderPass);
+        frames.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
     }
     
     PointRenderingSystem::~PointRenderingSystem() { vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr); }
 
-    void PointRenderingSystem::update(FrameInfo& frameInfo, GlobalUbo& ubo) {
+    void PointRenderingSystem::update(FrameInfo& frameInfo) {
         auto rotateLight = glm::rotate(glm::mat4(1.0f), frameInfo.frameTime, {0.0f, -1.0f, 0.0f});
             
-        int lightIndex = 0;
-        for (auto& kv: frameInfo.gameObjs) {
-            auto& obj = kv.second;
-            if (obj.pointLight == nullptr) {
-                continue;
-            }
-            obj.transform.translation = glm::vec3(rotateLight * glm::vec4(obj.transform.translation, 1.0f));
-            
-            ubo.pointLights[lightIndex].position = glm::vec4(obj.transform.translation, 1.0f);
-            ubo.pointLights[lightIndex].color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-            lightIndex+=1;
+        // the light buffer is filled by LightClusterSystem once they moved
+        auto& manager = frameInfo.gameObjectManager;
+        for (size_t i = 0; i < manager.lightCount(); i++) {
+            auto obj = manager.getGameObject(manager.getLightIds()[i]);
+            auto& transform = obj.transform();
+            transform.translation = glm::vec3(rotateLight * glm::vec4(transform.translation, 1.0f));
         }
-        ubo.numbLights = lightIndex;
     }
 
-    void PointRenderingSystem::render(FrameInfo &frameInfo) {
-
-        std::map<float, GameObj::id_t> sorted;
-        for (auto& kv: frameInfo.gameObjs) {
-            auto& obj = kv.second;
-            if (obj.pointLight == nullptr) { continue; }
+    void PointRenderingSystem::sortLights(FrameInfo &frameInfo) {
+        auto& manager = frameInfo.gameObjectManager;
+        auto& lightIds = manager.getLightIds();
+        auto lightCount = static_cast<uint32_t>(lightIds.size());
+        glm::vec3 cameraPosition = frameInfo.camera.getPosition();
 
-            // calculate distance
-            auto offset = frameInfo.camera.getPosition() - obj.transform.translation;
+        sortKeys.resize(lightCount);
+        for (uint32_t i = 0; i < lightCount; i++) {
+            auto offset = cameraPosition - manager.getTransforms()[manager.indexOf(lightIds[i])].translation;
             float disSquared = glm::dot(offset, offset);
-            sorted[disSquared] = obj.getId();
+            // the bits of a positive float sort like the float, inverted for back to front
+            uint32_t key = ~std::bit_cast<uint32_t>(disSquared);
+            sortKeys[i] = (static_cast<uint64_t>(key) << 32) | i;
         }
-        
+        radixSortHigh32(sortKeys, sortScratch);
+
+        // the fence of this frame has been waited on, its old buffer is free to go
+        auto& frame = frames[frameInfo.frameIndex];
+        if (!frame.buffer || frame.buffer->getInstanceCount() < lightCount) {
+            uint32_t capacity = frame.buffer ? frame.buffer->getInstanceCount() : MIN_INSTANCE_CAPACITY;
+            while (capacity < lightCount) { capacity *= 2; }
+            frame.buffer = std::make_unique<Buffer>(device, sizeof(BillboardInstance), capacity,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.buffer->map();
+        }
+
+        auto* instances = static_cast<BillboardInstance*>(frame.buffer->getMappedMemory());
+        auto& lights = manager.getLights();
+        for (uint32_t i = 0; i < lightCount; i++) {
+            auto light = static_cast<uint32_t>(sortKeys[i]);
+            uint32_t index = manager.indexOf(lightIds[light]);
+            auto& transform = manager.getTransforms()[index];
+            instances[i].position = glm::vec4(transform.translation, transform.scale.x);
+            instances[i].color = glm::vec4(manager.getColors()[index], lights[light].lightIntensity);
+        }
+        if (lightCount > 0) { frame.buffer->flush(); }
+        frame.count = lightCount;
+    }
+
+    void PointRenderingSystem::render(FrameInfo &frameInfo) {
+        auto& frame = frames[frameInfo.frameIndex];
+        if (frame.count == 0) { return; }
+        // only ever rendered from one thread at a time, waiting here is fine
+        if (pipeline == nullptr) { pipeline = pendingPipeline.get(); }
         pipeline->bind(frameInfo.commandBuffer);
 
         vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
             0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
 
-        for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
-            auto& obj = frameInfo.gameObjs.at(it->second);
-            
-            PointLightPushConstants push{};
-            push.position = glm::vec4(obj.transform.translation, 1.0f);
-            push.color = glm::vec4(obj.color, obj.pointLight->lightIntensity);
-            push.radius = obj.transform.scale.x;
-
-            vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PointLightPushConstants), &push);
-            vkCmdDraw(frameInfo.commandBuffer, 6, 1, 0, 0);
-        }
+        VkBuffer buffers[]{frame.buffer->getBuffer()};
+        VkDeviceSize offsets[]{0};
+        vkCmdBindVertexBuffers(frameInfo.commandBuffer, 0, 1, buffers, offsets);
+        vkCmdDraw(frameInfo.commandBuffer, 6, frame.count, 0, 0);
     }
 
     void PointRenderingSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
-        VkPushConstantRange pushConstantRange{};
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT
-        | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT|VK_SHADER_STAGE_GEOMETRY_BIT|VK_SHADER_STAGE_FRAGMENT_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(PointLightPushConstants);
-
         std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
         pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
         if (vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create pipeline layout!");
         }
     }
     
-    void PointRenderingSystem::createPipeline(VkRenderPass renderPass) {
+    void PointRenderingSystem::createPipeline(PipelineLibrary& pipelineLibrary, VkRenderPass renderPass) {
         assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
-        PipelineConfigInfo pipelineConfig{};
-        Pipeline::defaultPipelineConfigInfor(pipelineConfig);
-        Pipeline::enableAlphaBlending(pipelineConfig);
-        pipelineConfig.attributeDescriptions.clear();
-        pipelineConfig.bindingDescriptions.clear();
+        GraphicsPipelineDesc desc{};
+        Pipeline::defaultPipelineConfigInfor(desc.configInfo);
+        Pipeline::enableAlphaBlending(desc.configInfo);
+        // the quad comes from the vertex index, only the per light data is fetched
+        desc.configInfo.bindingDescriptions = {{0, sizeof(BillboardInstance), VK_VERTEX_INPUT_RATE_INSTANCE}};
+        desc.configInfo.attributeDescriptions = {
+            {0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(BillboardInstance, position)},
+            {1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(BillboardInstance, color)},
+        };
         
-        pipelineConfig.renderPass = renderPass;
-        pipelineConfig.pipelineLayout = pipelineLayout;
-        pipeline = std::make_unique<Pipeline>(device, "shaders/pointLight.vert.spv",
-                                              "shaders/pointLight.frag.spv", pipelineConfig);
-    
+        desc.configInfo.renderPass = renderPass;
+        desc.configInfo.pipelineLayout = pipelineLayout;
+        desc.vertFilepath = "shaders/pointLight.vert.spv";
+        desc.fragFilepath = "shaders/pointLight.frag.spv";
+        pendingPipeline = pipelineLibrary.compile(std::move(desc));
     }
 }
@@ -1,29 +1,51 @@
 ﻿#pragma once
 #include <memory>
+#include <vector>
 
+#include "Buffer.h"
 #include "FrameInfo.h"
-#include "Pipeline.h"
+#include "PipelineLibrary.h"
 
 namespace svk {
     struct FrameInfo;
 
     class PointRenderingSystem {
     public:
-        PointRenderingSystem(Device& dev, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+        PointRenderingSystem(Device& dev, PipelineLibrary& pipelineLibrary, VkRenderPass renderPass,
+            VkDescriptorSetLayout globalSetLayout);
         ~PointRenderingSystem();
 
         PointRenderingSystem(const PointRenderingSystem&) = delete;
         PointRenderingSystem& operator=(const PointRenderingSystem&) = delete;
 
-        void update(FrameInfo &frameInfo, GlobalUbo &ubo);
+        void update(FrameInfo &frameInfo);
+        // after update, writes the billboards back to front into the frame's instance buffer
+        void sortLights(FrameInfo &frameInfo);
+        // all billboards in one instanced draw
         void render(FrameInfo &frameInfo);
     private:
+        struct BillboardInstance {
+            glm::vec4 position; // w radius
+            glm::vec4 color; // w intensity
+        };
+
+        struct FrameInstances {
+            std::unique_ptr<Buffer> buffer;
+            uint32_t count = 0;
+        };
+
+        static constexpr uint32_t MIN_INSTANCE_CAPACITY = 64;
         
         void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-        void createPipeline(VkRenderPass renderPass);
+        void createPipeline(PipelineLibrary& pipelineLibrary, VkRenderPass renderPass);
         
         Device& device;
-        std::unique_ptr<Pipeline> pipeline;
+        PipelineLibrary::PipelineFuture pendingPipeline;
+        Pipeline* pipeline = nullptr;
         VkPipelineLayout pipelineLayout{};
+        std::vector<FrameInstances> frames;
+        // distance key in the high half, light index in the low half, kept around so sorting does not allocate
+        std::vector<uint64_t> sortKeys;
+        std::vector<uint64_t> sortScratch;
     };
 }
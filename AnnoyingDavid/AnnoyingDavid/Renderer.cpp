@@ -3,6 +3,8 @@
 #include <array>
 #include <stdexcept>
 
+#include "Descriptors.h"
+
 namespace svk {
 
     Renderer::Renderer(Window& win, Device& dev): window(win), device(dev) {
@@ -10,7 +12,10 @@ namespace svk {
         createCommandBuffers();
     }
     
-    Renderer::~Renderer() { freeCommandBuffers(); }
+    Renderer::~Renderer() {
+        destroyRecordingSlots();
+        freeCommandBuffers();
+    }
 
     VkCommandBuffer Renderer::beginFrame() {
         uint32_t imageIndex;
@@ -25,6 +30,14 @@ namespace svk {
         }
         isFrameStarted = true;
 
+        device.getDescriptorSetCache().nextFrame();
+        // the fence of this frame has signaled, its secondaries can be recorded again
+        for (auto& frames : recordingSlots) {
+            auto& slot = frames[currentFrameIndex];
+            vkResetCommandPool(device.getDevice(), slot.commandPool, 0);
+            slot.used = 0;
+        }
+
         auto commandBuffer = getCurrentCommandBuffer();
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -50,7 +63,7 @@ namespace svk {
         currentFrameIndex = (currentFrameIndex + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
     }
     
-    void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+    void Renderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfo.renderPass = swapChain->getRenderPass();
@@ -65,8 +78,11 @@ namespace svk {
         renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
         renderPassInfo.pClearValues = clearValues.data();
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+        if (contents == VK_SUBPASS_CONTENTS_INLINE) { setViewportAndScissor(commandBuffer); }
+    }
 
+    void Renderer::setViewportAndScissor(VkCommandBuffer commandBuffer) {
         VkViewport viewport{};
         viewport.x = 0.0f;
         viewport.y = 0.0f;
@@ -87,6 +103,80 @@ namespace svk {
         vkCmdEndRenderPass(commandBuffer);
     }
     
+    void Renderer::createRecordingSlots(uint32_t slotCount) {
+        destroyRecordingSlots();
+        QueueFamilyIndices queueFamilyIndices = device.findPhysicalQueueFamilies();
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        // reset as a whole once per frame
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        recordingSlots.resize(slotCount);
+        for (auto& frames : recordingSlots) {
+            frames.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+            for (auto& slot : frames) {
+                if (vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &slot.commandPool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create secondary command pool!");
+                }
+            }
+        }
+    }
+
+    void Renderer::destroyRecordingSlots() {
+        for (auto& frames : recordingSlots) {
+            for (auto& slot : frames) { vkDestroyCommandPool(device.getDevice(), slot.commandPool, nullptr); }
+        }
+        recordingSlots.clear();
+    }
+
+    VkCommandBuffer Renderer::beginSecondaryCommandBuffer(uint32_t slotIndex) {
+        assert(isFrameStarted && "Cannot record secondary command buffer when frame not in progress");
+        assert(slotIndex < recordingSlots.size() && "Recording slot out of range");
+        auto& slot = recordingSlots[slotIndex][currentFrameIndex];
+
+        if (slot.used == slot.commandBuffers.size()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = slot.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer commandBuffer;
+            if (vkAllocateCommandBuffers(device.getDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate secondary command buffer!");
+            }
+            slot.commandBuffers.push_back(commandBuffer);
+        }
+        VkCommandBuffer commandBuffer = slot.commandBuffers[slot.used++];
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = swapChain->getRenderPass();
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = swapChain->getFrameBuffer(currentImageIndex);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+            VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording secondary command buffer!");
+        }
+        // dynamic state is not inherited from the primary
+        setViewportAndScissor(commandBuffer);
+        return commandBuffer;
+    }
+
+    void Renderer::endSecondaryCommandBuffer(VkCommandBuffer commandBuffer) {
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record secondary command buffer!");
+        }
+    }
+
     void Renderer::createCommandBuffers() {
         commandBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
 
@@ -17,6 +17,7 @@ namespace svk {
 
         VkRenderPass getSwapChainRenderPass() const { return swapChain->getRenderPass(); }
         float getAspectRatio() const { return swapChain->extentAspectRatio(); };
+        VkExtent2D getExtent() const { return swapChain->getSwapChainExtent(); }
         bool isFrameInProgress() const{ return isFrameStarted; }
         VkCommandBuffer getCurrentCommandBuffer() const {
             assert(isFrameStarted && "Cannot get command buffer when frame not in progress");
@@ -30,13 +31,31 @@ namespace svk {
 
         VkCommandBuffer beginFrame();
         void endFrame();
-        void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+        // with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS everything inside the pass comes from secondaries
+        void beginSwapChainRenderPass(VkCommandBuffer commandBuffer,
+            VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
         void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
         void recreateSwapChain();
+
+        // Secondary command buffers inheriting the swap chain render pass. Every recording slot has its own
+        // command pool per frame in flight, so different threads may record into different slots at once.
+        void createRecordingSlots(uint32_t slotCount);
+        uint32_t getRecordingSlotCount() const { return static_cast<uint32_t>(recordingSlots.size()); }
+        // viewport and scissor are already set
+        VkCommandBuffer beginSecondaryCommandBuffer(uint32_t slot);
+        void endSecondaryCommandBuffer(VkCommandBuffer commandBuffer);
         
     private:
+        struct RecordingSlot {
+            VkCommandPool commandPool = VK_NULL_HANDLE;
+            std::vector<VkCommandBuffer> commandBuffers;
+            uint32_t used = 0;
+        };
+
         void createCommandBuffers();
         void freeCommandBuffers();
+        void destroyRecordingSlots();
+        void setViewportAndScissor(VkCommandBuffer commandBuffer);
        
         bool isRunning = true;
 
@@ -44,6 +63,8 @@ namespace svk {
         Device& device;
         std::unique_ptr<SwapChain> swapChain;
         std::vector<VkCommandBuffer> commandBuffers;
+        // [slot][frame]
+        std::vector<std::vector<RecordingSlot>> recordingSlots;
 
         uint32_t currentImageIndex;
         int currentFrameIndex = 0;
@@ -1,73 +1,500 @@
 ﻿#include "SimpleRenderSystem.h"
 
+#include <algorithm>
+#include <iterator>
 #include <stdexcept>
+#include <tuple>
 
 namespace svk {
-
-    struct SimplePushConstant
-    {
-        alignas(16) glm::mat4 modelMatrix{1.0f};
-        alignas(16) glm::mat4 normalMatrix{1.0f};
-    };
     
-    SimpleRenderSystem::SimpleRenderSystem(Device& dev, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout): device(dev) {
+    SimpleRenderSystem::SimpleRenderSystem(Device& dev, PipelineLibrary& library, VkRenderPass pass,
+        VkDescriptorSetLayout globalSetLayout, BindlessTextureTable* bindlessTable): device(dev), bindlessTextures(bindlessTable),
+        gpuDriven(bindlessTable != nullptr && dev.supportsGpuCulling()), pipelineLibrary(library), renderPass(pass) {
         createPipelineLayout(globalSetLayout);
-        createPipeline(renderPass);
+        createPipelines();
+        createInstanceBuffers();
+
+        if (gpuDriven) { createCullingResources(); }
     }
     
-    SimpleRenderSystem::~SimpleRenderSystem() { vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr); }
+    SimpleRenderSystem::~SimpleRenderSystem() {
+        vkDestroyPipelineLayout(device.getDevice(), pipelineLayout, nullptr);
+        if (cullPipelineLayout != VK_NULL_HANDLE) {
+            vkDestroyPipelineLayout(device.getDevice(), cullPipelineLayout, nullptr);
+        }
+    }
+
+    void SimpleRenderSystem::gatherDrawItems(FrameInfo &frameInfo, bool cpuCull) {
+        if (bindlessTextures) { bindlessTextures->collectGarbage(); }
+
+        auto& in = cullInput;
+        in.objects.clear();
+        auto& manager = frameInfo.gameObjectManager;
+        auto& models = manager.getModels();
+        auto& diffuseMaps = manager.getDiffuseMaps();
+        auto& specularMaps = manager.getSpecularMaps();
+        auto& transforms = manager.getTransforms();
+        for (uint32_t i = 0; i < manager.size(); i++) {
+            auto& model = models[i];
+            if (model == nullptr) {
+                continue;
+            }
+            // still streaming, draw it once the upload has been acquired
+            if (!model->isReady() || (diffuseMaps[i] && !diffuseMaps[i]->isReady()) ||
+                (specularMaps[i] && !specularMaps[i]->isReady())) {
+                continue;
+            }
+            in.objects.push_back(i);
+        }
+
+        // cull before anything touches descriptors or the command buffer
+        size_t count = in.objects.size();
+        in.visible.assign(count, 1);
+        if (cpuCull) {
+            in.x.resize(count);
+            in.y.resize(count);
+            in.z.resize(count);
+            in.radius.resize(count);
+            Frustum frustum = frameInfo.camera.getFrustum();
+            frameInfo.jobSystem.parallelFor(count, 256, [&](size_t begin, size_t end) {
+                for (size_t j = begin; j < end; j++) {
+                    uint32_t i = in.objects[j];
+                    glm::vec4 sphere = models[i]->getBoundingSphere();
+                    // updateBuffer already ran this frame, no need to redo the trig
+                    glm::vec3 center = manager.getObjectData(manager.getIds()[i]).modelMatrix *
+                        glm::vec4(glm::vec3(sphere), 1.0f);
+                    glm::vec3 scale = glm::abs(transforms[i].scale);
+                    in.x[j] = center.x;
+                    in.y[j] = center.y;
+                    in.z[j] = center.z;
+                    in.radius[j] = sphere.w * glm::max(scale.x, glm::max(scale.y, scale.z));
+                }
+                frustum.cullSpheres(in.x.data() + begin, in.y.data() + begin, in.z.data() + begin,
+                    in.radius.data() + begin, end - begin, in.visible.data() + begin);
+            });
+        }
+
+        // gather and sort so every group is one run of instances
+        drawItems.clear();
+        for (size_t i = 0; i < in.objects.size(); i++) {
+            if (!in.visible[i]) {
+                continue;
+            }
+            uint32_t index = in.objects[i];
+            auto& diffuseMap = diffuseMaps[index];
+            auto& specularMap = specularMaps[index];
+            Texture* placeholder = manager.getDefaultTexture().get();
+            // the bindless table only carries diffuse textures, those objects draw with the default texture
+            uint32_t material = PERMUTATION_DIFFUSE_MAP;
+            uint32_t textureIndex = 0;
+            if (bindlessTextures) {
+                textureIndex = bindlessTextures->getIndex(diffuseMap ? diffuseMap : manager.getDefaultTexture());
+            }
+            else {
+                material = (diffuseMap ? PERMUTATION_DIFFUSE_MAP : 0) | (specularMap ? PERMUTATION_SPECULAR_MAP : 0);
+            }
+            if (models[index]->getVertexFormat() == Model::VertexFormat::Packed) {
+                // packed variants are only compiled once a packed model shows up, start it before the draw needs it
+                material |= PERMUTATION_PACKED_VERTICES;
+                requestPermutation(material);
+            }
+            drawItems.push_back({models[index].get(), diffuseMap ? diffuseMap.get() : placeholder,
+                specularMap ? specularMap.get() : placeholder, manager.getIds()[index], textureIndex, material});
+        }
+        if (cpuCull) {
+            cullStats.visible = static_cast<uint32_t>(drawItems.size());
+            cullStats.culled = static_cast<uint32_t>(in.objects.size() - drawItems.size());
+        }
+        std::sort(drawItems.begin(), drawItems.end(), [](const DrawItem& a, const DrawItem& b) {
+            return std::tie(a.material, a.model, a.texture, a.specular) <
+                std::tie(b.material, b.model, b.texture, b.specular);
+        });
+    }
+
+    void SimpleRenderSystem::cullGameObjs(FrameInfo &frameInfo) {
+        if (!gpuDriven) {
+            gatherDrawItems(frameInfo, true);
+            auto& instanceBuffer = *instanceBuffers[frameInfo.frameIndex];
+            auto* instances = static_cast<InstanceData*>(instanceBuffer.getMappedMemory());
+            for (size_t i = 0; i < drawItems.size(); i++) {
+                instances[i] = {drawItems[i].id, drawItems[i].textureIndex};
+            }
+            instanceBuffer.flush();
+            return;
+        }
+        gatherDrawItems(frameInfo, false);
+
+        auto& frame = gpuFrames[frameInfo.frameIndex];
+        uint32_t drawCount = 0;
+        for (size_t i = 0; i < drawItems.size(); i++) {
+            if (i == 0 || drawItems[i].model != drawItems[i - 1].model) {
+                drawCount++;
+            }
+        }
+        growDrawBuffers(frame, drawCount);
+
+        auto* cullObjects = static_cast<CullObject*>(frame.cullObjects->getMappedMemory());
+        auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(frame.drawCommands->getMappedMemory());
+
+        // one command per model, its instance range is reserved for every object and filled by the shader
+        gpuDraws.clear();
+        for (size_t first = 0; first < drawItems.size();) {
+            size_t last = first + 1;
+            while (last < drawItems.size() && drawItems[last].model == drawItems[first].model) {
+                last++;
+            }
+            Model* model = drawItems[first].model;
+            uint32_t drawIndex = static_cast<uint32_t>(gpuDraws.size());
+            uint32_t instanceBase = static_cast<uint32_t>(first);
+
+            VkDrawIndexedIndirectCommand command{};
+            if (model->hasIndices()) {
+                command = {model->getIndexCount(), 0, 0, 0, instanceBase};
+            }
+            else {
+                // VkDrawIndirectCommand layout inside the same 20 byte slot
+                command = {model->getVertexCount(), 0, 0, static_cast<int32_t>(instanceBase), 0};
+            }
+            commands[drawIndex] = command;
+
+            glm::vec4 sphere = model->getBoundingSphere();
+            for (size_t i = first; i < last; i++) {
+                cullObjects[i] = {sphere, drawItems[i].id, drawItems[i].textureIndex, drawIndex, instanceBase};
+            }
+            gpuDraws.push_back(model);
+            first = last;
+        }
+        frame.cullObjects->flush();
+        frame.drawCommands->flush();
+
+        VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+        vkCmdFillBuffer(commandBuffer, frame.drawCounts->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+
+        VkMemoryBarrier clearBarrier{};
+        clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+        if (!drawItems.empty()) {
+            VkDescriptorSet cullSet = getCullSet(frameInfo);
+            cullPipeline->bind(commandBuffer);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+                0, 1, &cullSet, 0, nullptr);
+
+            CullPushConstant push{};
+            Frustum frustum = frameInfo.camera.getFrustum();
+            std::copy(std::begin(frustum.planes), std::end(frustum.planes), push.planes);
+            push.objectCount = static_cast<uint32_t>(drawItems.size());
+            vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                sizeof(CullPushConstant), &push);
+            vkCmdDispatch(commandBuffer, (push.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        }
+
+        VkMemoryBarrier cullBarrier{};
+        cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+    }
 
     void SimpleRenderSystem::renderGameObjs(FrameInfo &frameInfo) {
-        pipeline->bind(frameInfo.commandBuffer);
+        if (gpuDriven) {
+            renderGpuDriven(frameInfo, frameInfo.commandBuffer);
+            return;
+        }
+        prepareDrawGroups(frameInfo);
+        recordDrawGroups(frameInfo, frameInfo.commandBuffer, 0, drawGroups.size());
+    }
+
+    void SimpleRenderSystem::recordGameObjs(FrameInfo &frameInfo, Renderer &renderer,
+                                            std::vector<VkCommandBuffer> &secondaries) {
+        if (gpuDriven) {
+            // a handful of indirect draws, one buffer is plenty
+            if (gpuDraws.empty()) {
+                return;
+            }
+            VkCommandBuffer commandBuffer = renderer.beginSecondaryCommandBuffer(0);
+            renderGpuDriven(frameInfo, commandBuffer);
+            renderer.endSecondaryCommandBuffer(commandBuffer);
+            secondaries.push_back(commandBuffer);
+            return;
+        }
+        prepareDrawGroups(frameInfo);
+        if (drawGroups.empty()) {
+            return;
+        }
+
+        // every chunk records into its own slot, so no two threads ever share a command pool
+        size_t chunkCount = std::clamp<size_t>(drawGroups.size() / MIN_GROUPS_PER_SECONDARY, 1,
+            renderer.getRecordingSlotCount());
+        size_t chunkSize = (drawGroups.size() + chunkCount - 1) / chunkCount;
+        size_t firstSecondary = secondaries.size();
+        secondaries.resize(firstSecondary + chunkCount);
+        frameInfo.jobSystem.parallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++) {
+                VkCommandBuffer commandBuffer = renderer.beginSecondaryCommandBuffer(static_cast<uint32_t>(chunk));
+                recordDrawGroups(frameInfo, commandBuffer, std::min(chunk * chunkSize, drawGroups.size()),
+                    std::min((chunk + 1) * chunkSize, drawGroups.size()));
+                renderer.endSecondaryCommandBuffer(commandBuffer);
+                secondaries[firstSecondary + chunk] = commandBuffer;
+            }
+        });
+    }
+
+    void SimpleRenderSystem::prepareDrawGroups(FrameInfo &frameInfo) {
+        drawGroups.clear();
+        if (drawItems.empty()) {
+            return;
+        }
+        auto& instanceBuffer = *instanceBuffers[frameInfo.frameIndex];
+        auto objectBufferInfo = frameInfo.gameObjectManager.getBufferInfo(frameInfo.frameIndex);
+        auto instanceBufferInfo = instanceBuffer.descriptorInfo();
+
+        if (bindlessTextures) {
+            // objects and textures for the whole frame in one bind
+            frameSets[0] = getBindlessObjectSet(objectBufferInfo, instanceBufferInfo);
+            frameSets[1] = bindlessTextures->getDescriptorSet();
+        }
+        // descriptor sets are resolved up front, the cache is not safe to touch while recording in parallel
+        for (size_t first = 0; first < drawItems.size();) {
+            size_t last = first + 1;
+            while (last < drawItems.size() && sameGroup(drawItems[first], drawItems[last])) {
+                last++;
+            }
+            VkDescriptorSet set = VK_NULL_HANDLE;
+            if (!bindlessTextures) {
+                set = getDescriptorSet(drawItems[first], objectBufferInfo, instanceBufferInfo);
+            }
+            drawGroups.push_back({first, last, set, getPipeline(drawItems[first].material)});
+            first = last;
+        }
+    }
 
-        vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+    void SimpleRenderSystem::recordDrawGroups(FrameInfo &frameInfo, VkCommandBuffer commandBuffer,
+                                              size_t groupBegin, size_t groupEnd) const {
+        if (groupBegin == groupEnd) {
+            return;
+        }
+        // every permutation shares the layout, switching pipelines keeps the bound sets
+        Pipeline* boundPipeline = drawGroups[groupBegin].pipeline;
+        boundPipeline->bind(commandBuffer);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
             0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
-       
-        for(auto& kv: frameInfo.gameObjs) {
-            auto& obj = kv.second;
-            if (obj.model == nullptr) {
-                continue;
+        if (bindlessTextures) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                pipelineLayout, 1, 2, frameSets, 0, nullptr);
+        }
+
+        Model* boundModel = nullptr;
+        for (size_t i = groupBegin; i < groupEnd; i++) {
+            auto& group = drawGroups[i];
+            auto& item = drawItems[group.first];
+
+            if (group.pipeline != boundPipeline) {
+                group.pipeline->bind(commandBuffer);
+                boundPipeline = group.pipeline;
+            }
+            if (!bindlessTextures) {
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelineLayout, 1, 1,  &group.objectSet, 0, nullptr);
+            }
+
+            if (item.model != boundModel) {
+                item.model->bind(commandBuffer);
+                pushModelBounds(commandBuffer, *item.model);
+                boundModel = item.model;
             }
+            // gl_InstanceIndex starts at firstInstance, so it indexes straight into the id list
+            item.model->draw(commandBuffer, static_cast<uint32_t>(group.last - group.first),
+                static_cast<uint32_t>(group.first));
+        }
+    }
 
-            auto bufferInfo = obj.getBufferInfo(frameInfo.frameIndex);
-            
-            auto imageInfo = obj.diffuseMap->getImageInfo();
-            //auto imageInfo2 = obj.specularMap->getImageInfo();
-            
-            VkDescriptorSet gameObjectDescriptorSet;
-            DescriptorWriter(*renderSystemLayout, frameInfo.frameDescriptorPool).writeBuffer(0, &bufferInfo)
-                .writeImage(1, &imageInfo).build(gameObjectDescriptorSet);
+    void SimpleRenderSystem::renderGpuDriven(FrameInfo &frameInfo, VkCommandBuffer commandBuffer) {
+        if (gpuDraws.empty()) {
+            return;
+        }
+        auto& frame = gpuFrames[frameInfo.frameIndex];
 
-            //DescriptorWriter(*renderSystemLayout, frameInfo.frameDescriptorPool).writeBuffer(0, &bufferInfo)
-           //     .writeImage(2, &imageInfo2).build(gameObjectDescriptorSet);
+        Pipeline* fullPipeline = getPipeline(PERMUTATION_DIFFUSE_MAP);
+        Pipeline* packedPipeline = nullptr;
+        Pipeline* boundPipeline = fullPipeline;
+        boundPipeline->bind(commandBuffer);
 
-            vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                pipelineLayout, 1, 1,  &gameObjectDescriptorSet, 0, nullptr);
-            
-            SimplePushConstant push{};
-            push.modelMatrix = obj.transform.mat4();
-            push.normalMatrix = obj.transform.normalMatrix();
+        auto objectBufferInfo = frameInfo.gameObjectManager.getBufferInfo(frameInfo.frameIndex);
+        auto instanceBufferInfo = frame.visibleInstances->descriptorInfo();
+        VkDescriptorSet sets[] = {
+            frameInfo.globalDescriptorSet,
+            getBindlessObjectSet(objectBufferInfo, instanceBufferInfo),
+            bindlessTextures->getDescriptorSet()};
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipelineLayout, 0, 3, sets, 0, nullptr);
 
-            vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout,
-                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                              sizeof(SimplePushConstant), &push);
-            obj.model->bind(frameInfo.commandBuffer);
-            obj.model->draw(frameInfo.commandBuffer);
+        // instance counts come from the cull shader, models nothing survived for are skipped by the count
+        bool useCount = device.supportsDrawIndirectCount();
+        for (uint32_t i = 0; i < gpuDraws.size(); i++) {
+            // draws are sorted by material, so this switches at most once
+            Pipeline* pipeline = fullPipeline;
+            if (gpuDraws[i]->getVertexFormat() == Model::VertexFormat::Packed) {
+                if (packedPipeline == nullptr) {
+                    packedPipeline = getPipeline(PERMUTATION_DIFFUSE_MAP | PERMUTATION_PACKED_VERTICES);
+                }
+                pipeline = packedPipeline;
+            }
+            if (pipeline != boundPipeline) {
+                pipeline->bind(commandBuffer);
+                boundPipeline = pipeline;
+            }
+            gpuDraws[i]->bind(commandBuffer);
+            pushModelBounds(commandBuffer, *gpuDraws[i]);
+            gpuDraws[i]->drawIndirect(commandBuffer, frame.drawCommands->getBuffer(),
+                i * sizeof(VkDrawIndexedIndirectCommand),
+                useCount ? frame.drawCounts->getBuffer() : VK_NULL_HANDLE, i * sizeof(uint32_t));
         }
     }
 
-    void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+    void SimpleRenderSystem::pushModelBounds(VkCommandBuffer commandBuffer, const Model& model) const {
+        if (model.getVertexFormat() != Model::VertexFormat::Packed) {
+            return;
+        }
+        ModelPushConstant push{};
+        push.positionOffset = glm::vec4(model.getBoundsMin(), 0.0f);
+        push.positionScale = glm::vec4(model.getBoundsMax() - model.getBoundsMin(), 0.0f);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+            sizeof(ModelPushConstant), &push);
+    }
+
+    VkDescriptorSet SimpleRenderSystem::getCullSet(FrameInfo &frameInfo) {
+        auto& frame = gpuFrames[frameInfo.frameIndex];
+        auto objectBufferInfo = frameInfo.gameObjectManager.getBufferInfo(frameInfo.frameIndex);
+        auto cullObjectsInfo = frame.cullObjects->descriptorInfo();
+        auto drawCommandsInfo = frame.drawCommands->descriptorInfo();
+        auto drawCountsInfo = frame.drawCounts->descriptorInfo();
+        auto visibleInstancesInfo = frame.visibleInstances->descriptorInfo();
+
+        VkDescriptorSet set;
+        DescriptorWriter writer(*cullSetLayout, device.getDescriptorSetCache());
+        writer.writeBuffer(0, &objectBufferInfo).writeBuffer(1, &cullObjectsInfo).writeBuffer(2, &drawCommandsInfo)
+            .writeBuffer(3, &drawCountsInfo).writeBuffer(4, &visibleInstancesInfo);
+        if (!writer.build(set)) {
+            throw std::runtime_error("failed to allocate culling descriptor set!");
+        }
+        return set;
+    }
+
+    void SimpleRenderSystem::createCullingResources() {
+        cullSetLayout = DescriptorSetLayout::Builder(device)
+            .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .addBinding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+            .build();
+
         VkPushConstantRange pushConstantRange{};
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
         pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(SimplePushConstant);
+        pushConstantRange.size = sizeof(CullPushConstant);
 
-        renderSystemLayout = DescriptorSetLayout::Builder(device).addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
+        VkDescriptorSetLayout cullLayout = cullSetLayout->getDescriptorSetLayout();
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &cullLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(device.getDevice(), &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+        cullPipeline = std::make_unique<ComputePipeline>(device, "shaders/cull.comp.spv", cullPipelineLayout);
+
+        gpuFrames.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        for (auto& frame : gpuFrames) {
+            frame.cullObjects = std::make_unique<Buffer>(device, sizeof(CullObject),
+                GameObjectManager::MAX_GAME_OBJECTS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            frame.cullObjects->map();
+            growDrawBuffers(frame, MIN_GPU_DRAWS);
+            frame.visibleInstances = std::make_unique<Buffer>(device, sizeof(InstanceData),
+                GameObjectManager::MAX_GAME_OBJECTS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+    }
+
+    void SimpleRenderSystem::growDrawBuffers(GpuFrameResources& frame, uint32_t drawCount) {
+        if (frame.drawCommands && frame.drawCommands->getInstanceCount() >= drawCount) {
+            return;
+        }
+        // the fence of this frame has been waited on, its old buffers are free to go
+        uint32_t capacity = frame.drawCommands ? frame.drawCommands->getInstanceCount() : MIN_GPU_DRAWS;
+        while (capacity < drawCount) { capacity *= 2; }
+        frame.drawCommands = std::make_unique<Buffer>(device, sizeof(VkDrawIndexedIndirectCommand), capacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        frame.drawCommands->map();
+        frame.drawCounts = std::make_unique<Buffer>(device, sizeof(uint32_t), capacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    VkDescriptorSet SimpleRenderSystem::getDescriptorSet(const DrawItem& item,
+        VkDescriptorBufferInfo& objectBufferInfo, VkDescriptorBufferInfo& instanceBufferInfo) {
+        auto imageInfo = item.texture->getImageInfo();
+        auto specularInfo = item.specular->getImageInfo();
+
+        // one set per texture pair and frame in flight, the cache hands back the same one every frame
+        VkDescriptorSet set;
+        DescriptorWriter writer(*renderSystemLayout, device.getDescriptorSetCache());
+        writer.writeBuffer(0, &objectBufferInfo).writeImage(1, &imageInfo).writeBuffer(2, &instanceBufferInfo)
+            .writeImage(3, &specularInfo);
+        if (!writer.build(set)) {
+            throw std::runtime_error("failed to allocate render system descriptor set!");
+        }
+        return set;
+    }
+
+    VkDescriptorSet SimpleRenderSystem::getBindlessObjectSet(VkDescriptorBufferInfo& objectBufferInfo,
+        VkDescriptorBufferInfo& instanceBufferInfo) {
+        VkDescriptorSet set;
+        DescriptorWriter writer(*renderSystemLayout, device.getDescriptorSetCache());
+        writer.writeBuffer(0, &objectBufferInfo).writeBuffer(2, &instanceBufferInfo);
+        if (!writer.build(set)) {
+            throw std::runtime_error("failed to allocate render system descriptor set!");
+        }
+        return set;
+    }
+
+    void SimpleRenderSystem::createInstanceBuffers() {
+        instanceBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+        for (auto& buffer : instanceBuffers) {
+            buffer = std::make_unique<Buffer>(device, sizeof(InstanceData), GameObjectManager::MAX_GAME_OBJECTS,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            buffer->map();
+        }
+    }
+
+    void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+        renderSystemLayout = DescriptorSetLayout::Builder(device).addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+              VK_SHADER_STAGE_VERTEX_BIT)
           .addBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+          .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+          .addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
           .build();
 
+        // the bindless path leaves bindings 1 and 3 unwritten and reads textures from set 2 instead
         std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout, renderSystemLayout->getDescriptorSetLayout()};
+        if (bindlessTextures) { descriptorSetLayouts.push_back(bindlessTextures->getDescriptorSetLayout()); }
+
+        // only the packed vertex shader reads it, both variants share the layout
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(ModelPushConstant);
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -81,15 +508,48 @@ namespace svk {
         }
     }
     
-    void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
+    void SimpleRenderSystem::createPipelines() {
+        // every material variant of the full vertex format up front, the packed ones are requested by
+        // gatherDrawItems once a packed model is drawn. lights are looked up per cluster so they need no variants
+        if (bindlessTextures) {
+            requestPermutation(PERMUTATION_DIFFUSE_MAP);
+            return;
+        }
+        for (uint32_t material = 0; material <= (PERMUTATION_DIFFUSE_MAP | PERMUTATION_SPECULAR_MAP); material++) {
+            requestPermutation(material);
+        }
+    }
+
+    PipelineLibrary::PipelineFuture& SimpleRenderSystem::requestPermutation(uint32_t permutation) {
+        auto it = permutations.find(permutation);
+        if (it != permutations.end()) {
+            return it->second;
+        }
         assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
-        PipelineConfigInfo pipelineConfig{};
-        Pipeline::defaultPipelineConfigInfor(pipelineConfig);
-        pipelineConfig.renderPass = renderPass;
-        pipelineConfig.pipelineLayout = pipelineLayout;
-        pipeline = std::make_unique<Pipeline>(device, "shaders/shader1.vert.spv",
-                                              "shaders/shader1.frag.spv", pipelineConfig);
-    
+        GraphicsPipelineDesc desc{};
+        Pipeline::defaultPipelineConfigInfor(desc.configInfo);
+        desc.configInfo.renderPass = renderPass;
+        desc.configInfo.pipelineLayout = pipelineLayout;
+        if (permutation & PERMUTATION_PACKED_VERTICES) {
+            desc.vertFilepath = "shaders/shader1_packed.vert.spv";
+            desc.configInfo.bindingDescriptions = Model::PackedVertex::getBindingDescriptions();
+            desc.configInfo.attributeDescriptions = Model::PackedVertex::getAttributeDescriptions();
+        }
+        else {
+            desc.vertFilepath = "shaders/shader1.vert.spv";
+        }
+        desc.fragFilepath = bindlessTextures ? "shaders/shader1_bindless.frag.spv" : "shaders/shader1.frag.spv";
+
+        // constant ids match shader1.frag
+        VkBool32 diffuseMap = (permutation & PERMUTATION_DIFFUSE_MAP) != 0;
+        VkBool32 specularMap = (permutation & PERMUTATION_SPECULAR_MAP) != 0;
+        desc.configInfo.setSpecializationConstant(0, diffuseMap);
+        desc.configInfo.setSpecializationConstant(1, specularMap);
+        return permutations.emplace(permutation, pipelineLibrary.compile(std::move(desc))).first->second;
+    }
+
+    Pipeline* SimpleRenderSystem::getPipeline(uint32_t material) {
+        return requestPermutation(material).get();
     }
 }
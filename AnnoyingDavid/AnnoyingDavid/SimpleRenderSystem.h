@@ -1,29 +1,161 @@
 ﻿#pragma once
+#include "BindlessTextureTable.h"
 #include "Camera.h"
 #include "Device.h"
 #include "FrameInfo.h"
 #include "GameObj.h"
-#include "Pipeline.h"
+#include "PipelineLibrary.h"
+#include "Renderer.h"
+
+#include <unordered_map>
+#include <vector>
 
 namespace svk {
     class SimpleRenderSystem {
     public:
-        SimpleRenderSystem(Device& dev, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+        // with a bindless table all textures come from one array and objects are only grouped by model
+        // pipelines compile on the library's workers, the first render waits for the ones it needs
+        SimpleRenderSystem(Device& dev, PipelineLibrary& pipelineLibrary, VkRenderPass renderPass,
+            VkDescriptorSetLayout globalSetLayout, BindlessTextureTable* bindlessTable = nullptr);
         ~SimpleRenderSystem();
 
         SimpleRenderSystem(const SimpleRenderSystem&) = delete;
         SimpleRenderSystem& operator=(const SimpleRenderSystem&) = delete;
         
+        // culls and fills the instance list, on the gpu driven path records the culling dispatch.
+        // call before the render pass begins, it touches no state the other systems use and may run on a worker
+        void cullGameObjs(FrameInfo &frameInfo);
         void renderGameObjs(FrameInfo &frameInfo);
+        // same as renderGameObjs, but the draws are split across the job system into secondary command
+        // buffers of the renderer's recording slots, appended to secondaries in execution order
+        void recordGameObjs(FrameInfo &frameInfo, Renderer &renderer, std::vector<VkCommandBuffer> &secondaries);
+        // needs the bindless table, textures are picked per instance after culling
+        bool isGpuDriven() const { return gpuDriven; }
+
+        struct CullStats {
+            uint32_t visible = 0;
+            uint32_t culled = 0;
+        };
+        // cpu path only, counts of the last rendered frame
+        const CullStats& getCullStats() const { return cullStats; }
     private:
+        struct DrawItem {
+            Model* model;
+            Texture* texture;
+            Texture* specular; // the default texture when the object has none, the material bits say so
+            GameObj::id_t id;
+            uint32_t textureIndex;
+            uint32_t material; // PERMUTATION_* bits
+        };
+
+        // matches the Instances buffer in shader1.vert
+        struct InstanceData {
+            GameObj::id_t objectId;
+            uint32_t textureIndex; // slot in the bindless table, unused otherwise
+        };
+
+        // one run of instances sharing model and set
+        struct DrawGroup {
+            size_t first;
+            size_t last;
+            VkDescriptorSet objectSet; // unused with the bindless table
+            Pipeline* pipeline;
+        };
+
+        // matches CullObjects in cull.comp
+        struct CullObject {
+            glm::vec4 sphere;
+            GameObj::id_t objectId;
+            uint32_t textureIndex;
+            uint32_t drawIndex;
+            uint32_t instanceBase;
+        };
+
+        // matches Push in shader1.vert built with PACKED_VERTICES, maps the unorm positions onto the bounds
+        struct ModelPushConstant {
+            glm::vec4 positionOffset;
+            glm::vec4 positionScale;
+        };
+
+        struct CullPushConstant {
+            glm::vec4 planes[6];
+            uint32_t objectCount;
+        };
+
+        // world space bounding spheres of the draw candidates, one array per component
+        struct CullInput {
+            std::vector<float> x;
+            std::vector<float> y;
+            std::vector<float> z;
+            std::vector<float> radius;
+            std::vector<uint8_t> visible;
+            std::vector<uint32_t> objects; // dense indices into the game object manager
+        };
+
+        struct GpuFrameResources {
+            std::unique_ptr<Buffer> cullObjects;
+            std::unique_ptr<Buffer> drawCommands; // one VkDrawIndexedIndirectCommand sized slot per model, grows
+            std::unique_ptr<Buffer> drawCounts;
+            std::unique_ptr<Buffer> visibleInstances;
+        };
+
+        // draw slots per frame to start with, doubled whenever a frame has more models
+        static constexpr uint32_t MIN_GPU_DRAWS = 256;
+        static constexpr uint32_t CULL_GROUP_SIZE = 64;
+        static constexpr size_t MIN_GROUPS_PER_SECONDARY = 64;
+        // shader1.frag specialization
+        static constexpr uint32_t PERMUTATION_DIFFUSE_MAP = 1u << 0;
+        static constexpr uint32_t PERMUTATION_SPECULAR_MAP = 1u << 1;
+        // shader1_packed.vert and the Model::PackedVertex input layout
+        static constexpr uint32_t PERMUTATION_PACKED_VERTICES = 1u << 2;
         
         void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
-        void createPipeline(VkRenderPass renderPass);
+        void createPipelines();
+        PipelineLibrary::PipelineFuture& requestPermutation(uint32_t permutation);
+        // only from the thread driving the system, recording jobs get the pointers through the draw groups
+        Pipeline* getPipeline(uint32_t material);
+        void createInstanceBuffers();
+        void createCullingResources();
+        void gatherDrawItems(FrameInfo &frameInfo, bool cpuCull);
+        void prepareDrawGroups(FrameInfo &frameInfo);
+        void recordDrawGroups(FrameInfo &frameInfo, VkCommandBuffer commandBuffer, size_t groupBegin,
+            size_t groupEnd) const;
+        void renderGpuDriven(FrameInfo &frameInfo, VkCommandBuffer commandBuffer);
+        // packed models only, the full format needs no push constant
+        void pushModelBounds(VkCommandBuffer commandBuffer, const Model& model) const;
+        VkDescriptorSet getCullSet(FrameInfo &frameInfo);
+        void growDrawBuffers(GpuFrameResources& frame, uint32_t drawCount);
+        VkDescriptorSet getDescriptorSet(const DrawItem& item,
+            VkDescriptorBufferInfo& objectBufferInfo, VkDescriptorBufferInfo& instanceBufferInfo);
+        VkDescriptorSet getBindlessObjectSet(VkDescriptorBufferInfo& objectBufferInfo,
+            VkDescriptorBufferInfo& instanceBufferInfo);
+        bool sameGroup(const DrawItem& a, const DrawItem& b) const {
+            return a.model == b.model && a.material == b.material &&
+                (bindlessTextures != nullptr || (a.texture == b.texture && a.specular == b.specular));
+        }
         
         Device& device;
-        std::unique_ptr<Pipeline> pipeline;
+        BindlessTextureTable* bindlessTextures;
+        bool gpuDriven;
+        PipelineLibrary& pipelineLibrary;
+        VkRenderPass renderPass;
+        std::unordered_map<uint32_t, PipelineLibrary::PipelineFuture> permutations;
         VkPipelineLayout pipelineLayout{};
         
         std::unique_ptr<DescriptorSetLayout> renderSystemLayout;
+
+        // per frame list of game object ids, one contiguous run per (model, texture) group
+        std::vector<std::unique_ptr<Buffer>> instanceBuffers;
+        std::vector<DrawItem> drawItems;
+        std::vector<DrawGroup> drawGroups;
+        VkDescriptorSet frameSets[2]{}; // bindless object set and texture table
+        CullInput cullInput;
+        CullStats cullStats;
+
+        std::unique_ptr<DescriptorSetLayout> cullSetLayout;
+        VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+        std::unique_ptr<ComputePipeline> cullPipeline;
+        std::vector<GpuFrameResources> gpuFrames;
+        std::vector<Model*> gpuDraws; // by draw index, filled in cullGameObjs
     };
 }
@@ -25,7 +25,7 @@ namespace svk {
         for (int i = 0; i < depthImages.size(); i++) {
             vkDestroyImageView(device.getDevice(), depthImageViews[i], nullptr);
             vkDestroyImage(device.getDevice(), depthImages[i], nullptr);
-            vkFreeMemory(device.getDevice(), depthImageMemorys[i], nullptr);
+            device.getAllocator().free(depthImageMemorys[i]);
         }
 
         for (auto framebuffer : swapChainFramebuffers) {
@@ -2,6 +2,7 @@
 
 #include <stdexcept>
 
+#include "Descriptors.h"
 #include "stb_image.h"
 
 namespace svk {
@@ -92,10 +93,11 @@ namespace svk {
     }
 
     Texture::~Texture() {
+      device.getDescriptorSetCache().forgetImage(mTextureImageView, mTextureSampler);
       vkDestroySampler(device.getDevice(), mTextureSampler, nullptr);
       vkDestroyImageView(device.getDevice(), mTextureImageView, nullptr);
       vkDestroyImage(device.getDevice(), mTextureImage, nullptr);
-      vkFreeMemory(device.getDevice(), mTextureImageMemory, nullptr);
+      device.getAllocator().free(mTextureImageMemory);
     }
 
     void Texture::updateDescriptor() {
@@ -198,23 +200,6 @@ namespace svk {
       // mMipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
       mMipLevels = 1;
 
-      VkBuffer stagingBuffer;
-      VkDeviceMemory stagingBufferMemory;
-
-      device.createBuffer(
-          imageSize,
-          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-          stagingBuffer,
-          stagingBufferMemory);
-
-      void *data;
-      vkMapMemory(device.getDevice(), stagingBufferMemory, 0, imageSize, 0, &data);
-      memcpy(data, pixels, static_cast<size_t>(imageSize));
-      vkUnmapMemory(device.getDevice(), stagingBufferMemory);
-
-      stbi_image_free(pixels);
-
       format = VK_FORMAT_R8G8B8A8_SRGB;
       extent = {static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1};
 
@@ -233,31 +218,16 @@ namespace svk {
       imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
       device.createImageWithInfo(imageInfo,VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mTextureImage, mTextureImageMemory);
-      device.transitionImageLayout(
-          mTextureImage,
-          VK_FORMAT_R8G8B8A8_SRGB,
-          VK_IMAGE_LAYOUT_UNDEFINED,
-          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-          mMipLevels,
-          mLayerCount);
-      device.copyBufferToImage(
-          stagingBuffer,
-          mTextureImage,
-          static_cast<uint32_t>(texWidth),
-          static_cast<uint32_t>(texHeight),
-          mLayerCount);
 
+      // staging, copy and both layout transitions are recorded into the uploader's current batch
       // comment this out if using mips
-      device.transitionImageLayout(mTextureImage, VK_FORMAT_R8G8B8A8_SRGB,
-          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-          mMipLevels, mLayerCount);
+      uploadTicket = device.getUploader().uploadImage(pixels, imageSize, mTextureImage, extent, mMipLevels,
+          mLayerCount);
+      stbi_image_free(pixels);
 
       // If we generate mip maps then the final image will alerady be READ_ONLY_OPTIMAL
       // mDevice.generateMipmaps(mTextureImage, mFormat, texWidth, texHeight, mMipLevels);
       mTextureLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-      vkDestroyBuffer(device.getDevice(), stagingBuffer, nullptr);
-      vkFreeMemory(device.getDevice(), stagingBufferMemory, nullptr);
     }
 
     void Texture::createTextureImageView(VkImageViewType viewType) {
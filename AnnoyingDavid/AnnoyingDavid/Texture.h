@@ -28,6 +28,8 @@ namespace svk {
         VkImageLayout getImageLayout() const { return mTextureLayout; }
         VkExtent3D getExtent() const { return extent; }
         VkFormat getFormat() const { return format; }
+        // false while the pixels are still streaming in
+        bool isReady() const { return device.getUploader().isReady(uploadTicket); }
 
         void updateDescriptor();
         void transitionLayout(
@@ -45,7 +47,7 @@ namespace svk {
 
         Device &device;
         VkImage mTextureImage = nullptr;
-        VkDeviceMemory mTextureImageMemory = nullptr;
+        Allocation mTextureImageMemory{};
         VkImageView mTextureImageView = nullptr;
         VkSampler mTextureSampler = nullptr;
         VkFormat format;
@@ -53,5 +55,6 @@ namespace svk {
         uint32_t mMipLevels{1};
         uint32_t mLayerCount{1};
         VkExtent3D extent{};
+        uint64_t uploadTicket = 0;
     };
 }
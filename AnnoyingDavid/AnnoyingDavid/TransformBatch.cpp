@@ -0,0 +1,193 @@
+﻿#include "TransformBatch.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if SVK_TRANSFORM_SSE
+#include <emmintrin.h>
+#endif
+
+namespace svk {
+    static void writeMatrices(const TransfromComponent &t, float c1, float s1, float c2, float s2, float c3, float s3,
+                              GameObjectBufferData &out) {
+        // rotation part of Ry * Rx * Rz, see TransfromComponent::mat4
+        const glm::mat3 r{
+            {c1 * c3 + s1 * s2 * s3, c2 * s3, c1 * s2 * s3 - c3 * s1},
+            {c3 * s1 * s2 - c1 * s3, c2 * c3, c1 * c3 * s2 + s1 * s3},
+            {c2 * s1, -s2, c1 * c2}};
+        const glm::vec3 invScale = 1.0f / t.scale;
+        out.modelMatrix = glm::mat4{
+            glm::vec4(r[0] * t.scale.x, 0.0f),
+            glm::vec4(r[1] * t.scale.y, 0.0f),
+            glm::vec4(r[2] * t.scale.z, 0.0f),
+            glm::vec4(t.translation, 1.0f)};
+        out.normalMatrix = glm::mat4{glm::mat3{r[0] * invScale.x, r[1] * invScale.y, r[2] * invScale.z}};
+    }
+
+    void computeTransformsScalar(const TransfromComponent *transforms, size_t count, GameObjectBufferData *out) {
+        for (size_t i = 0; i < count; i++) {
+            auto &t = transforms[i];
+            writeMatrices(t, glm::cos(t.rotation.y), glm::sin(t.rotation.y), glm::cos(t.rotation.x),
+                          glm::sin(t.rotation.x), glm::cos(t.rotation.z), glm::sin(t.rotation.z), out[i]);
+        }
+    }
+
+#if SVK_TRANSFORM_SSE
+    // cephes style sincos, range reduction by pi/4 and a minimax polynomial per octant.
+    // accurate to about 1e-7 for the angles a transform sees
+    static void sincos4(__m128 x, __m128 &s, __m128 &c) {
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+        __m128 signSin = _mm_and_ps(x, signMask);
+        x = _mm_andnot_ps(signMask, x);
+
+        // octant, rounded up to even
+        __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+        j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        __m128 y = _mm_cvtepi32_ps(j);
+
+        __m128 swapSignSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+        __m128 signCos = _mm_castsi128_ps(
+            _mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+        __m128 polyMask = _mm_castsi128_ps(
+            _mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+        signSin = _mm_xor_ps(signSin, swapSignSin);
+
+        // x - y * pi/4 in three steps to keep the precision
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+        x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+        __m128 z = _mm_mul_ps(x, x);
+
+        __m128 cosPoly = _mm_set1_ps(2.443315711809948e-5f);
+        cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(-1.388731625493765e-3f));
+        cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(4.166664568298827e-2f));
+        cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+        cosPoly = _mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+        cosPoly = _mm_add_ps(cosPoly, _mm_set1_ps(1.0f));
+
+        __m128 sinPoly = _mm_set1_ps(-1.9515295891e-4f);
+        sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(8.3321608736e-3f));
+        sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(-1.6666654611e-1f));
+        sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+        // octants 1 and 2 swap the polynomials
+        __m128 sinResult = _mm_or_ps(_mm_and_ps(polyMask, sinPoly), _mm_andnot_ps(polyMask, cosPoly));
+        __m128 cosResult = _mm_or_ps(_mm_and_ps(polyMask, cosPoly), _mm_andnot_ps(polyMask, sinPoly));
+        s = _mm_xor_ps(sinResult, signSin);
+        c = _mm_xor_ps(cosResult, signCos);
+    }
+
+    // four lanes of one matrix column, transposed so every object gets its column in one store
+    static void storeColumns(__m128 x, __m128 y, __m128 z, __m128 w, GameObjectBufferData *out, bool normal,
+                             int column) {
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        __m128 columns[4]{x, y, z, w};
+        for (int lane = 0; lane < 4; lane++) {
+            auto &matrix = normal ? out[lane].normalMatrix : out[lane].modelMatrix;
+            _mm_storeu_ps(&matrix[column][0], columns[lane]);
+        }
+    }
+
+    void computeTransforms(const TransfromComponent *transforms, size_t count, GameObjectBufferData *out) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const TransfromComponent *t = transforms + i;
+#define SVK_GATHER(member) _mm_set_ps(t[3].member, t[2].member, t[1].member, t[0].member)
+            __m128 s1, c1, s2, c2, s3, c3;
+            sincos4(SVK_GATHER(rotation.y), s1, c1);
+            sincos4(SVK_GATHER(rotation.x), s2, c2);
+            sincos4(SVK_GATHER(rotation.z), s3, c3);
+            __m128 scaleX = SVK_GATHER(scale.x);
+            __m128 scaleY = SVK_GATHER(scale.y);
+            __m128 scaleZ = SVK_GATHER(scale.z);
+
+            __m128 s2s3 = _mm_mul_ps(s2, s3);
+            __m128 c3s2 = _mm_mul_ps(c3, s2);
+            __m128 r00 = _mm_add_ps(_mm_mul_ps(c1, c3), _mm_mul_ps(s1, s2s3));
+            __m128 r01 = _mm_mul_ps(c2, s3);
+            __m128 r02 = _mm_sub_ps(_mm_mul_ps(c1, s2s3), _mm_mul_ps(c3, s1));
+            __m128 r10 = _mm_sub_ps(_mm_mul_ps(s1, c3s2), _mm_mul_ps(c1, s3));
+            __m128 r11 = _mm_mul_ps(c2, c3);
+            __m128 r12 = _mm_add_ps(_mm_mul_ps(c1, c3s2), _mm_mul_ps(s1, s3));
+            __m128 r20 = _mm_mul_ps(c2, s1);
+            __m128 r21 = _mm_sub_ps(zero, s2);
+            __m128 r22 = _mm_mul_ps(c1, c2);
+
+            GameObjectBufferData *o = out + i;
+            storeColumns(_mm_mul_ps(r00, scaleX), _mm_mul_ps(r01, scaleX), _mm_mul_ps(r02, scaleX), zero, o, false, 0);
+            storeColumns(_mm_mul_ps(r10, scaleY), _mm_mul_ps(r11, scaleY), _mm_mul_ps(r12, scaleY), zero, o, false, 1);
+            storeColumns(_mm_mul_ps(r20, scaleZ), _mm_mul_ps(r21, scaleZ), _mm_mul_ps(r22, scaleZ), zero, o, false, 2);
+            storeColumns(SVK_GATHER(translation.x), SVK_GATHER(translation.y), SVK_GATHER(translation.z), one, o,
+                         false, 3);
+#undef SVK_GATHER
+
+            __m128 invX = _mm_div_ps(one, scaleX);
+            __m128 invY = _mm_div_ps(one, scaleY);
+            __m128 invZ = _mm_div_ps(one, scaleZ);
+            storeColumns(_mm_mul_ps(r00, invX), _mm_mul_ps(r01, invX), _mm_mul_ps(r02, invX), zero, o, true, 0);
+            storeColumns(_mm_mul_ps(r10, invY), _mm_mul_ps(r11, invY), _mm_mul_ps(r12, invY), zero, o, true, 1);
+            storeColumns(_mm_mul_ps(r20, invZ), _mm_mul_ps(r21, invZ), _mm_mul_ps(r22, invZ), zero, o, true, 2);
+            for (int lane = 0; lane < 4; lane++) { o[lane].normalMatrix[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); }
+        }
+        computeTransformsScalar(transforms + i, count - i, out + i);
+    }
+#else
+    void computeTransforms(const TransfromComponent *transforms, size_t count, GameObjectBufferData *out) {
+        computeTransformsScalar(transforms, count, out);
+    }
+#endif
+
+    void benchmarkTransforms(size_t objectCount, int iterations) {
+        std::mt19937 rng{42};
+        std::uniform_real_distribution<float> angle(-glm::two_pi<float>(), glm::two_pi<float>());
+        std::uniform_real_distribution<float> scale(0.1f, 4.0f);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+
+        std::vector<TransfromComponent> transforms(objectCount);
+        for (auto &t : transforms) {
+            t.translation = {position(rng), position(rng), position(rng)};
+            t.scale = {scale(rng), scale(rng), scale(rng)};
+            t.rotation = {angle(rng), angle(rng), angle(rng)};
+        }
+        std::vector<GameObjectBufferData> reference(objectCount);
+        std::vector<GameObjectBufferData> scalar(objectCount);
+        std::vector<GameObjectBufferData> batched(objectCount);
+
+        auto time = [iterations](auto &&kernel) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; i++) { kernel(); }
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+        };
+        double referenceMs = time([&] {
+            for (size_t i = 0; i < objectCount; i++) {
+                reference[i].modelMatrix = transforms[i].mat4();
+                reference[i].normalMatrix = transforms[i].normalMatrix();
+            }
+        });
+        double scalarMs = time([&] { computeTransformsScalar(transforms.data(), objectCount, scalar.data()); });
+        double batchedMs = time([&] { computeTransforms(transforms.data(), objectCount, batched.data()); });
+
+        float maxError = 0.0f;
+        for (size_t i = 0; i < objectCount; i++) {
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    maxError = glm::max(maxError, glm::abs(batched[i].modelMatrix[c][r] - reference[i].modelMatrix[c][r]));
+                    maxError = glm::max(maxError, glm::abs(batched[i].normalMatrix[c][r] - reference[i].normalMatrix[c][r]));
+                }
+            }
+        }
+
+        printf("transforms: %zu objects, %d iterations, sse %s\n", objectCount, iterations,
+               SVK_TRANSFORM_SSE ? "on" : "off");
+        printf("  per object mat4/normalMatrix: %.3f ms\n", referenceMs);
+        printf("  scalar kernel:                %.3f ms (%.2fx)\n", scalarMs, referenceMs / scalarMs);
+        printf("  batched kernel:               %.3f ms (%.2fx)\n", batchedMs, referenceMs / batchedMs);
+        printf("  max abs error: %g\n", maxError);
+    }
+}
@@ -0,0 +1,19 @@
+﻿#pragma once
+#include "GameObj.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SVK_TRANSFORM_SSE 1
+#else
+#define SVK_TRANSFORM_SSE 0
+#endif
+
+namespace svk {
+    // Same result as TransfromComponent::mat4() and normalMatrix(), but the sin/cos of every object
+    // is computed once for both matrices. With SSE four objects share one vectorized sincos,
+    // the scalar kernel handles the remainder and machines without SSE.
+    void computeTransforms(const TransfromComponent *transforms, size_t count, GameObjectBufferData *out);
+    void computeTransformsScalar(const TransfromComponent *transforms, size_t count, GameObjectBufferData *out);
+
+    // times the per object path against both kernels and prints the results
+    void benchmarkTransforms(size_t objectCount, int iterations);
+}
@@ -5,27 +5,22 @@
 #include <glm/glm.hpp>
 
 #include <chrono>
+#include <stdexcept>
 
+#include "LightClusterSystem.h"
 #include "MovementController.h"
+#include "PipelineLibrary.h"
 #include "PointRenderingSystem.h"
 #include "SimpleRenderSystem.h"
 
 namespace svk
 {
     TriangleApp::TriangleApp() {
-        globalPool = DescriptorPool::Builder(device).setMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
-        .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT).build();
-        // build frame descriptor pools
-        framePools.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        auto framePoolBuilder = DescriptorPool::Builder(device)
-                                    .setMaxSets(1000)
-                                    .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000)
-                                    .addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000)
-                                    .setPoolFlags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
-        for (int i = 0; i < framePools.size(); i++) {
-            framePools[i] = framePoolBuilder.build();
-        }
         loadGameObjs();
+        device.getUploader().flush();
+#ifndef NDEBUG
+        device.getAllocator().printStats();
+#endif
     }
     
     TriangleApp::~TriangleApp() { }
@@ -38,25 +33,35 @@ namespace svk
             uboBuffers[i]->map();
         }
         
+        // 1 to 3 are the light clusters, the binning pass reads the ubo too
         auto globalSetLayout = DescriptorSetLayout::Builder(device)
-        .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).build();
-        
-        std::vector<VkDescriptorSet> globalDescriptorSets(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (int i = 0; i < globalDescriptorSets.size(); ++i) {
-            auto bufferInfo = uboBuffers[i]->descriptorInfo();
-            DescriptorWriter(*globalSetLayout, *globalPool).writeBuffer(0, &bufferInfo)
-            .build(globalDescriptorSets[i]);
-        }
+        .addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+        .addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT)
+        .build();
+        LightClusterSystem lightClusters{device, globalSetLayout->getDescriptorSetLayout()};
         
-        SimpleRenderSystem simpleRenderSystem{device, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
-        PointRenderingSystem pointRenderSystem{device, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+        std::unique_ptr<BindlessTextureTable> bindlessTextures;
+        if (device.supportsBindless()) { bindlessTextures = std::make_unique<BindlessTextureTable>(device); }
+
+        // both systems only queue their pipelines, they compile side by side while the rest starts up
+        PipelineLibrary pipelineLibrary{device, jobSystem};
+        SimpleRenderSystem simpleRenderSystem{device, pipelineLibrary, renderer.getSwapChainRenderPass(),
+            globalSetLayout->getDescriptorSetLayout(), bindlessTextures.get()};
+        PointRenderingSystem pointRenderSystem{device, pipelineLibrary, renderer.getSwapChainRenderPass(),
+            globalSetLayout->getDescriptorSetLayout()};
         Camera camera{};
 
-        auto& viewerObject = gameObjectManager.createGameObject();
-        viewerObject.transform.translation = {0.0f, -3.0f, -5.0f};
-        viewerObject.transform.rotation = {glm::radians(-30.0f), 0.0f, 0.0f};
+        auto viewerObject = gameObjectManager.createGameObject();
+        viewerObject.transform().translation = {0.0f, -3.0f, -5.0f};
+        viewerObject.transform().rotation = {glm::radians(-30.0f), 0.0f, 0.0f};
         MovementController cameraController{};
         auto currentTime = std::chrono::high_resolution_clock::now();
+        JobSystem::TaskGraph frameGraph;
+        std::vector<VkCommandBuffer> secondaries;
+        // one slot for every thread that can pick up a chunk
+        renderer.createRecordingSlots(jobSystem.getWorkerCount() + 1);
         
         while (isRunning) {
             SDL_Event e;
@@ -97,52 +102,95 @@ namespace svk
             frameTime = glm::min(frameTime, 0.5f);
 
             cameraController.update(frameTime, viewerObject);
-            camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
+            // through the const array, transform() would mark the viewer dirty every frame
+            auto& viewerTransform = gameObjectManager.getTransforms()[gameObjectManager.indexOf(viewerObject.getId())];
+            camera.setViewYXZ(viewerTransform.translation, viewerTransform.rotation);
                 
             float aspect = renderer.getAspectRatio();
             camera.setPerspectiveProjection(glm::radians(50.0f), aspect, 0.1f, 100);
             
+            // anything loaded since the last frame goes out before this frame is submitted
+            device.getUploader().flush();
+
             if (auto commandBuffer = renderer.beginFrame()) {
                 int frameIndex = renderer.getFrameIndex();
-                framePools[frameIndex]->resetPool();
+                device.getUploader().recordAcquires(commandBuffer);
+
+                // the light buffers may have grown, the cache hands back the old set while they have not
+                lightClusters.prepareFrame(frameIndex, gameObjectManager.lightCount());
+                auto uboInfo = uboBuffers[frameIndex]->descriptorInfo();
+                DescriptorWriter globalWriter(*globalSetLayout, device.getDescriptorSetCache());
+                globalWriter.writeBuffer(0, &uboInfo);
+                VkDescriptorSet globalDescriptorSet;
+                if (!lightClusters.writeDescriptors(frameIndex, globalWriter).build(globalDescriptorSet)) {
+                    throw std::runtime_error("failed to allocate global descriptor set!");
+                }
                 FrameInfo frameInfo{frameIndex, frameTime, commandBuffer, camera,
-                    globalDescriptorSets[frameIndex], *framePools[frameIndex],
-                gameObjectManager.gameObjects};
+                    globalDescriptorSet, gameObjectManager, jobSystem};
 
                 //todo how to correctly update
-                //gameObjectManager.gameObjects.at(1).transform.rotation =
+                //gameObjectManager.getGameObject(1).transform().rotation =
                 //    {glm::radians(45.0f * frameTime ), 0.0f, 0.0f};
                 //
                 //auto rotation = glm::rotate(glm::mat4(1.0f), frameInfo.frameTime,
                 //    {0.0f, -1.0f, 0.0f});
-                //auto& obj = gameObjectManager.gameObjects.at(gameObjectManager.usedIds.at(0));
-                //obj.transform.translation = glm::vec3(rotation * glm::vec4(obj.transform.translation, 1.0f));
+                //auto obj = gameObjectManager.getGameObject(gameObjectManager.getIds().at(0));
+                //obj.transform().translation = glm::vec3(rotation * glm::vec4(obj.transform().translation, 1.0f));
                 
-                //update
+                //update, the lights move first, everything after only reads them
                 GlobalUbo ubo{};
                 ubo.projection = camera.getProjection();
                 ubo.view = camera.getView();
                 ubo.inverseView = camera.getInverseView();
-                pointRenderSystem.update(frameInfo, ubo);
-                uboBuffers[frameIndex]->writeToBuffer(&ubo);
-                uboBuffers[frameIndex]->flush();
-
-                gameObjectManager.updateBuffer(frameIndex);
+                VkExtent2D extent = renderer.getExtent();
+                frameGraph.clear();
+                auto lights = frameGraph.add([&] { pointRenderSystem.update(frameInfo); });
+                auto lightData = frameGraph.add([&] { lightClusters.update(frameInfo, ubo, extent); }, {lights});
+                frameGraph.add([&] {
+                    uboBuffers[frameIndex]->writeToBuffer(&ubo);
+                    uboBuffers[frameIndex]->flush();
+                }, {lightData});
+                frameGraph.add([&] { pointRenderSystem.sortLights(frameInfo); }, {lights});
+                auto transforms = frameGraph.add([&] { gameObjectManager.updateBuffer(frameIndex, jobSystem); },
+                    {lights});
+                frameGraph.add([&] { simpleRenderSystem.cullGameObjs(frameInfo); }, {transforms});
+                jobSystem.run(frameGraph);
+                lightClusters.dispatch(frameInfo);
                 
                 //render
-                renderer.beginSwapChainRenderPass(commandBuffer);
-                simpleRenderSystem.renderGameObjs(frameInfo);
-                pointRenderSystem.render(frameInfo);
+                if (PARALLEL_RECORDING) {
+                    renderer.beginSwapChainRenderPass(commandBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+                    secondaries.clear();
+                    simpleRenderSystem.recordGameObjs(frameInfo, renderer, secondaries);
+
+                    // blended, so after all opaque work
+                    FrameInfo lightFrameInfo = frameInfo;
+                    lightFrameInfo.commandBuffer = renderer.beginSecondaryCommandBuffer(0);
+                    pointRenderSystem.render(lightFrameInfo);
+                    renderer.endSecondaryCommandBuffer(lightFrameInfo.commandBuffer);
+                    secondaries.push_back(lightFrameInfo.commandBuffer);
+
+                    vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+                }
+                else {
+                    renderer.beginSwapChainRenderPass(commandBuffer);
+                    simpleRenderSystem.renderGameObjs(frameInfo);
+                    pointRenderSystem.render(frameInfo);
+                }
                 renderer.endSwapChainRenderPass(commandBuffer);
                 renderer.endFrame();
             }
         }
         vkDeviceWaitIdle(device.getDevice());
+#ifndef NDEBUG
+        device.getDescriptorSetCache().printStats();
+#endif
     }
     
     void TriangleApp::loadGameObjs() {
         
-        std::shared_ptr model = Model::createModelFromFile(device, "models/skull/skull.obj");
+        std::shared_ptr model = Model::createModelFromFile(device, "models/skull/skull.obj", jobSystem,
+            MODEL_VERTEX_FORMAT);
         std::shared_ptr texture = Texture::createTextureFromFile(device, "models/skull/skull.jpg");
         std::shared_ptr specTexture = Texture::createTextureFromFile(device, "models/skull/skullSpec.png");
         glm::vec3 scale = {0.06f, 0.06f, 0.06f};
@@ -167,14 +215,14 @@ namespace svk
         }
         
         for (auto& transform : skullTransforms) {
-            auto& skull1 = gameObjectManager.createGameObject();
-            skull1.model = model;
-            skull1.diffuseMap = texture;
-            //skull1.specularMap = specTexture;
-            skull1.transform = transform;
+            auto skull1 = gameObjectManager.createGameObject();
+            skull1.model() = model;
+            skull1.diffuseMap() = texture;
+            //skull1.specularMap() = specTexture;
+            skull1.transform() = transform;
         }
         
-        model = Model::createModelFromFile(device, "models/quad.obj");
+        model = Model::createModelFromFile(device, "models/quad.obj", jobSystem, MODEL_VERTEX_FORMAT);
         texture = Texture::createTextureFromFile(device, "textures/bg.JPG");
         scale = {6.0f, 6.0f, 6.0f};
         std::vector<TransfromComponent> planeTransforms = {
@@ -187,10 +235,10 @@ namespace svk
         };
 
         for (auto& transform : planeTransforms) {
-            auto& plane = gameObjectManager.createGameObject();
-            plane.model = model;
-            plane.diffuseMap = texture;
-            plane.transform = transform;
+            auto plane = gameObjectManager.createGameObject();
+            plane.model() = model;
+            plane.diffuseMap() = texture;
+            plane.transform() = transform;
         }
         
         std::vector<glm::vec3> lightColors{
@@ -203,11 +251,11 @@ namespace svk
         };
 
         for (int i = 0; i < lightColors.size(); ++i) {
-            auto& pointLight = gameObjectManager.makePointLight(0.1f);
-            pointLight.color = lightColors[i];
+            auto pointLight = gameObjectManager.makePointLight(0.1f);
+            pointLight.color() = lightColors[i];
             glm::vec3 rotation = {glm::radians(90.0f), 0.0f, 0.0f};
             auto rotateLight = glm::rotate(glm::mat4(1.0f), (i * glm::two_pi<float>()) / lightColors.size(), {0.0f, -1.0f, 0.0f});
-            pointLight.transform.translation = glm::vec3(rotateLight * glm::vec4(-2.0f, -3.0f, -2.0f, 1.0f));
+            pointLight.transform().translation = glm::vec3(rotateLight * glm::vec4(-2.0f, -3.0f, -2.0f, 1.0f));
         }
     }
 }
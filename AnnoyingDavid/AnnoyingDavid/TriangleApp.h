@@ -3,6 +3,7 @@
 
 #include "Descriptors.h"
 #include "GameObj.h"
+#include "JobSystem.h"
 #include "Model.h"
 #include "Window.h"
 #include "Renderer.h"
@@ -12,6 +13,10 @@ namespace svk {
     public:
         static constexpr int WIDTH = 1500;
         static constexpr int HEIGHT = 845;
+        // record the main pass into secondary command buffers on the job system instead of inline
+        static constexpr bool PARALLEL_RECORDING = true;
+        // Full by default, Packed uploads meshes as Model::PackedVertex for a third of the vertex fetch bandwidth
+        static constexpr Model::VertexFormat MODEL_VERTEX_FORMAT = Model::VertexFormat::Full;
 
         TriangleApp();
         ~TriangleApp();
@@ -29,8 +34,7 @@ namespace svk {
         Device device{window};
         Renderer renderer{window, device};
 
-        std::unique_ptr<DescriptorPool> globalPool{};
-        std::vector<std::unique_ptr<DescriptorPool>> framePools;
         GameObjectManager gameObjectManager{device};
+        JobSystem jobSystem{};
     };
 }
@@ -0,0 +1,342 @@
+﻿#include "UploadManager.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Device.h"
+
+namespace svk {
+    // keeps every copy offset valid for any texel size and optimalBufferCopyOffsetAlignment
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr VkAccessFlags BUFFER_READ_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+        VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    static constexpr VkPipelineStageFlags BUFFER_READ_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    UploadManager::UploadManager(Device& dev) : device{dev} {
+        QueueFamilyIndices indices = device.findPhysicalQueueFamilies();
+        graphicsFamily = indices.graphicsFamily.value();
+        transferFamily = indices.transferFamily.value();
+        ownershipTransfer = indices.hasDedicatedTransfer();
+        queue = ownershipTransfer ? device.GetTransferQueue() : device.GetGraphicsQueue();
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = transferFamily;
+
+        if (vkCreateCommandPool(device.getDevice(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+
+        device.createBuffer(RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, ringBuffer, ringMemory);
+    }
+
+    UploadManager::~UploadManager() {
+        waitIdle();
+        for (auto& batch : freeBatches) { vkDestroyFence(device.getDevice(), batch->fence, nullptr); }
+        vkDestroyCommandPool(device.getDevice(), commandPool, nullptr);
+        vkDestroyBuffer(device.getDevice(), ringBuffer, nullptr);
+        device.getAllocator().free(ringMemory);
+    }
+
+    uint64_t UploadManager::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer,
+                                         VkDeviceSize dstOffset) {
+        std::lock_guard<std::mutex> lock(mutex);
+        StagingSpan staging = reserveStaging(size, STAGING_ALIGNMENT);
+        memcpy(staging.mapped, data, static_cast<size_t>(size));
+
+        Batch& batch = currentBatch();
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = staging.offset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(batch.commandBuffer, staging.buffer, dstBuffer, 1, &copyRegion);
+        batch.hasBufferCopies = true;
+
+        if (ownershipTransfer) {
+            // the release half is recorded at submit, this is the acquire half for the graphics queue
+            VkBufferMemoryBarrier acquire{};
+            acquire.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            acquire.srcAccessMask = 0;
+            acquire.dstAccessMask = BUFFER_READ_ACCESS;
+            acquire.srcQueueFamilyIndex = transferFamily;
+            acquire.dstQueueFamilyIndex = graphicsFamily;
+            acquire.buffer = dstBuffer;
+            acquire.offset = dstOffset;
+            acquire.size = size;
+            batch.bufferAcquires.push_back(acquire);
+        }
+        return batch.ticket;
+    }
+
+    uint64_t UploadManager::uploadImage(const void* pixels, VkDeviceSize size, VkImage image, VkExtent3D extent,
+                                        uint32_t mipLevels, uint32_t layerCount) {
+        std::lock_guard<std::mutex> lock(mutex);
+        StagingSpan staging = reserveStaging(size, STAGING_ALIGNMENT);
+        memcpy(staging.mapped, pixels, static_cast<size_t>(size));
+
+        Batch& batch = currentBatch();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = layerCount;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = staging.offset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = layerCount;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = extent;
+        vkCmdCopyBufferToImage(batch.commandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &region);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        if (!ownershipTransfer) {
+            vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            return batch.ticket;
+        }
+
+        // release, the layout transition happens once and both halves have to describe it identically
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        batch.imageAcquires.push_back(barrier);
+        return batch.ticket;
+    }
+
+    uint64_t UploadManager::flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        retire(false);
+        uint64_t ticket = recording ? recording->ticket : nextTicket - 1;
+        submitCurrent();
+        return ticket;
+    }
+
+    bool UploadManager::isComplete(uint64_t ticket) {
+        std::lock_guard<std::mutex> lock(mutex);
+        retire(false);
+        return ticket <= completedTicket;
+    }
+
+    void UploadManager::waitIdle() {
+        std::lock_guard<std::mutex> lock(mutex);
+        submitCurrent();
+        while (!inFlight.empty()) { retire(true); }
+    }
+
+    void UploadManager::recordAcquires(VkCommandBuffer commandBuffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        retire(false);
+        if (pendingAcquireTicket == 0) { return; }
+
+        // the release batch fence has signaled on the host, so it happens before this submission
+        if (!pendingBufferAcquires.empty()) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, BUFFER_READ_STAGES, 0,
+                0, nullptr, static_cast<uint32_t>(pendingBufferAcquires.size()), pendingBufferAcquires.data(),
+                0, nullptr);
+        }
+        if (!pendingImageAcquires.empty()) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                static_cast<uint32_t>(pendingImageAcquires.size()), pendingImageAcquires.data());
+        }
+        pendingBufferAcquires.clear();
+        pendingImageAcquires.clear();
+        readyTicket.store(pendingAcquireTicket, std::memory_order_release);
+        pendingAcquireTicket = 0;
+    }
+
+    UploadManager::Batch& UploadManager::currentBatch() {
+        if (recording) { return *recording; }
+
+        if (!freeBatches.empty()) {
+            recording = std::move(freeBatches.back());
+            freeBatches.pop_back();
+        }
+        else {
+            recording = std::make_unique<Batch>();
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = commandPool;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(device.getDevice(), &allocInfo, &recording->commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate upload command buffer!");
+            }
+
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(device.getDevice(), &fenceInfo, nullptr, &recording->fence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create upload fence!");
+            }
+        }
+
+        recording->ticket = nextTicket++;
+        recording->hasBufferCopies = false;
+        recording->bufferAcquires.clear();
+        recording->imageAcquires.clear();
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(recording->commandBuffer, &beginInfo);
+        return *recording;
+    }
+
+    UploadManager::StagingSpan UploadManager::reserveStaging(VkDeviceSize size, VkDeviceSize alignment) {
+        StagingSpan span{};
+
+        // anything bigger than half the ring gets a throwaway staging buffer that dies with its batch
+        if (size > RING_SIZE / 2) {
+            Allocation memory{};
+            device.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, span.buffer, memory);
+            span.mapped = memory.mapped;
+            currentBatch().overflowBuffers.emplace_back(span.buffer, memory);
+            return span;
+        }
+
+        VkDeviceSize offset = 0;
+        while (!tryReserveRing(size, alignment, offset)) {
+            // ring is full of data the gpu still has to read, push ours and wait for the oldest batch only
+            submitCurrent();
+            if (inFlight.empty()) { throw std::runtime_error("failed to reserve staging memory!"); }
+            retire(true);
+        }
+        span.buffer = ringBuffer;
+        span.offset = offset;
+        span.mapped = static_cast<char*>(ringMemory.mapped) + offset;
+        return span;
+    }
+
+    bool UploadManager::tryReserveRing(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+        // head == tail always means empty, a full ring keeps one byte between them
+        VkDeviceSize aligned = alignUp(ringHead, alignment);
+        if (ringHead >= ringTail) {
+            if (aligned + size <= RING_SIZE) {
+                offset = aligned;
+                ringHead = aligned + size;
+                return true;
+            }
+            if (size < ringTail) {
+                offset = 0;
+                ringHead = size;
+                return true;
+            }
+            return false;
+        }
+        if (aligned + size < ringTail) {
+            offset = aligned;
+            ringHead = aligned + size;
+            return true;
+        }
+        return false;
+    }
+
+    void UploadManager::submitCurrent() {
+        if (!recording) { return; }
+        Batch& batch = *recording;
+
+        if (batch.hasBufferCopies && !ownershipTransfer) {
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = BUFFER_READ_ACCESS;
+            vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, BUFFER_READ_STAGES,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+        if (!batch.bufferAcquires.empty()) {
+            std::vector<VkBufferMemoryBarrier> releases = batch.bufferAcquires;
+            for (auto& release : releases) {
+                release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                release.dstAccessMask = 0;
+            }
+            vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, static_cast<uint32_t>(releases.size()),
+                releases.data(), 0, nullptr);
+        }
+        vkEndCommandBuffer(batch.commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+        // on a shared queue later frame submissions are ordered behind the barriers above
+        if (vkQueueSubmit(queue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit upload batch!");
+        }
+        if (!ownershipTransfer) { readyTicket.store(batch.ticket, std::memory_order_release); }
+        batch.ringEnd = ringHead;
+        inFlight.push_back(std::move(recording));
+    }
+
+    void UploadManager::retire(bool waitForOldest) {
+        if (waitForOldest && !inFlight.empty()) {
+            vkWaitForFences(device.getDevice(), 1, &inFlight.front()->fence, VK_TRUE, UINT64_MAX);
+        }
+
+        while (!inFlight.empty() && vkGetFenceStatus(device.getDevice(), inFlight.front()->fence) == VK_SUCCESS) {
+            auto batch = std::move(inFlight.front());
+            inFlight.pop_front();
+
+            ringTail = batch->ringEnd;
+            if (ringTail == ringHead) {
+                ringHead = 0;
+                ringTail = 0;
+            }
+
+            for (auto& kv : batch->overflowBuffers) {
+                vkDestroyBuffer(device.getDevice(), kv.first, nullptr);
+                device.getAllocator().free(kv.second);
+            }
+            batch->overflowBuffers.clear();
+            vkResetFences(device.getDevice(), 1, &batch->fence);
+
+            if (ownershipTransfer) {
+                pendingBufferAcquires.insert(pendingBufferAcquires.end(), batch->bufferAcquires.begin(),
+                    batch->bufferAcquires.end());
+                pendingImageAcquires.insert(pendingImageAcquires.end(), batch->imageAcquires.begin(),
+                    batch->imageAcquires.end());
+                pendingAcquireTicket = batch->ticket;
+            }
+
+            completedTicket = batch->ticket;
+            freeBatches.push_back(std::move(batch));
+        }
+    }
+}
@@ -0,0 +1,96 @@
+﻿#pragma once
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "MemoryAllocator.h"
+
+namespace svk {
+    class Device;
+
+    // Streams data into device local buffers and images through one persistently mapped staging ring.
+    // Copies are recorded into a single command buffer until flush() submits them with a fence,
+    // the ring space of a batch is reused once its fence has signaled. Nothing waits on the queue.
+    // With a dedicated transfer family the batches run on the transfer queue and release ownership,
+    // the matching acquires are recorded into a frame command buffer by recordAcquires().
+    class UploadManager {
+    public:
+        static constexpr VkDeviceSize RING_SIZE = 32ull * 1024 * 1024;
+
+        UploadManager(Device& dev);
+        ~UploadManager();
+
+        UploadManager(const UploadManager&) = delete;
+        UploadManager& operator=(const UploadManager&) = delete;
+
+        // the returned ticket can be checked with isComplete(), data is copied before returning
+        uint64_t uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+        // transitions the whole image to SHADER_READ_ONLY_OPTIMAL
+        uint64_t uploadImage(const void* pixels, VkDeviceSize size, VkImage image, VkExtent3D extent,
+            uint32_t mipLevels = 1, uint32_t layerCount = 1);
+
+        // submits everything recorded so far, returns the ticket of the submitted batch
+        uint64_t flush();
+        // the copy has finished on the gpu, the staging memory is free again
+        bool isComplete(uint64_t ticket);
+        // resources of this ticket may be used by commands recorded from now on
+        bool isReady(uint64_t ticket) const { return ticket <= readyTicket.load(std::memory_order_acquire); }
+        void waitIdle();
+
+        // call once per frame outside a render pass, before anything that may use the uploaded resources
+        void recordAcquires(VkCommandBuffer commandBuffer);
+
+    private:
+        struct Batch {
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+            uint64_t ticket = 0;
+            VkDeviceSize ringEnd = 0;
+            bool hasBufferCopies = false;
+            std::vector<std::pair<VkBuffer, Allocation>> overflowBuffers{};
+            // only used for queue family ownership transfers
+            std::vector<VkBufferMemoryBarrier> bufferAcquires{};
+            std::vector<VkImageMemoryBarrier> imageAcquires{};
+        };
+
+        struct StagingSpan {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            void* mapped = nullptr;
+        };
+
+        Batch& currentBatch();
+        StagingSpan reserveStaging(VkDeviceSize size, VkDeviceSize alignment);
+        bool tryReserveRing(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+        void submitCurrent();
+        void retire(bool waitForOldest);
+
+        Device& device;
+        std::mutex mutex;
+
+        VkQueue queue = VK_NULL_HANDLE;
+        uint32_t transferFamily = 0;
+        uint32_t graphicsFamily = 0;
+        bool ownershipTransfer = false;
+
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkBuffer ringBuffer = VK_NULL_HANDLE;
+        Allocation ringMemory{};
+        VkDeviceSize ringHead = 0;
+        VkDeviceSize ringTail = 0;
+
+        std::unique_ptr<Batch> recording;
+        std::deque<std::unique_ptr<Batch>> inFlight;
+        std::vector<std::unique_ptr<Batch>> freeBatches;
+        uint64_t nextTicket = 1;
+        uint64_t completedTicket = 0;
+        std::atomic<uint64_t> readyTicket{0};
+
+        // released on the transfer queue and waiting for the graphics side to acquire them
+        std::vector<VkBufferMemoryBarrier> pendingBufferAcquires;
+        std::vector<VkImageMemoryBarrier> pendingImageAcquires;
+        uint64_t pendingAcquireTicket = 0;
+    };
+}
@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include <cstdint>
 #include <functional>
 
 namespace svk
@@ -9,4 +10,14 @@ namespace svk
         seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
         (hashCombine(seed, rest), ...);
     };
+
+    // stable across runs and compilers, unlike std::hash, so it can be written to disk
+    inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+        auto bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
 }
\ No newline at end of file
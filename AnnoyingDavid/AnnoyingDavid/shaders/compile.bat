@@ -1,5 +1,9 @@
 C:/VulkanSDK/1.3.231.0/Bin/glslc.exe shader1.vert -o shader1.vert.spv
+C:/VulkanSDK/1.3.231.0/Bin/glslc.exe -DPACKED_VERTICES shader1.vert -o shader1_packed.vert.spv
 C:/VulkanSDK/1.3.231.0/Bin/glslc.exe shader1.frag -o shader1.frag.spv
+C:/VulkanSDK/1.3.231.0/Bin/glslc.exe -DBINDLESS shader1.frag -o shader1_bindless.frag.spv
 C:/VulkanSDK/1.3.231.0/Bin/glslc.exe pointLight.vert -o pointLight.vert.spv
 C:/VulkanSDK/1.3.231.0/Bin/glslc.exe pointLight.frag -o pointLight.frag.spv
+C:/VulkanSDK/1.3.231.0/Bin/glslc.exe cull.comp -o cull.comp.spv
+C:/VulkanSDK/1.3.231.0/Bin/glslc.exe cluster_lights.comp -o cluster_lights.comp.spv
 pause
\ No newline at end of file
@@ -1,32 +1,22 @@
 #version 450
 
 layout (location = 0) in vec2 fragOffset;
+layout (location = 1) in vec3 fragColor;
 
 layout (location = 0) out vec4 outColor;
 
-struct PointLight {
-    vec4 position;
-    vec4 color;
-};
-
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projection;
     mat4 view;
     mat4 invView;
     vec4 lightColor;
-    PointLight pointLights[10];
-    int numLights;
+    vec4 clusterParams;
+    uvec4 clusterGrid;
 } ubo;
 
-layout(push_constant) uniform Push {
-    vec4 position;
-    vec4 color;
-    float radius;
-} push;
-
 void main() {
     float dist = sqrt(dot(fragOffset, fragOffset));
     if (dist >= 1.0f) { discard; }
     float cosDis = 0.5 * (cos(dist * 3.14f) + 1.0); // ranges from 1 -> 0
-    outColor = vec4(push.color.xyz + 0.5 * cosDis, cosDis);
+    outColor = vec4(fragColor + 0.5 * cosDis, cosDis);
 }
\ No newline at end of file
@@ -9,35 +9,31 @@ const vec2 OFFSETS[6] = vec2[](
     vec2(1.0, 1.0)
 );
 
-layout (location = 0) out vec2 fragOffset;
+// one instance per light, back to front
+layout (location = 0) in vec4 lightPosition; // w radius
+layout (location = 1) in vec4 lightColor; // w intensity
 
-struct PointLight {
-    vec4 position;
-    vec4 color;
-};
+layout (location = 0) out vec2 fragOffset;
+layout (location = 1) out vec3 fragColor;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projection;
     mat4 view;
     mat4 invView;
     vec4 lightColor;
-    PointLight pointLights[10];
-    int numLights;
+    vec4 clusterParams;
+    uvec4 clusterGrid;
 } ubo;
 
-layout(push_constant) uniform Push {
-    vec4 position;
-    vec4 color;
-    float radius;
-} push;
-
 void main() {
     fragOffset = OFFSETS[gl_VertexIndex];
+    fragColor = lightColor.xyz;
     vec3 cameraRightWorld = {ubo.view[0][0], ubo.view[1][0], ubo.view[2][0]};
     vec3 cameraUpWorld = {ubo.view[0][1], ubo.view[1][1], ubo.view[2][1]};
     
-    vec3 positionWorld = push.position.xyz + push.radius * fragOffset.x * cameraRightWorld 
-        + push.radius * fragOffset.y * cameraUpWorld;
+    float radius = lightPosition.w;
+    vec3 positionWorld = lightPosition.xyz + radius * fragOffset.x * cameraRightWorld 
+        + radius * fragOffset.y * cameraUpWorld;
     
     gl_Position = ubo.projection * ubo.view * vec4(positionWorld, 1.0f);
 }
\ No newline at end of file
@@ -1,20 +1,23 @@
 #version 450
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec3 fragPosWorld;
 layout(location = 2) in vec3 fragNormalWorld;
 layout(location = 3) in vec2 fragUv;
+layout(location = 4) flat in uint fragTextureIndex;
 
 layout(location = 0) out vec4 outColor;
 
-layout(push_constant) uniform Push {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-} push;
+// set per pipeline by SimpleRenderSystem, dead branches are removed when the pipeline compiles
+layout(constant_id = 0) const bool HAS_DIFFUSE_MAP = true;
+layout(constant_id = 1) const bool HAS_SPECULAR_MAP = false;
 
 struct PointLight {
-    vec4 position;
-    vec4 color;
+    vec4 position; // w radius
+    vec4 color; // w intensity
 };
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
@@ -22,19 +25,38 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 view;
     mat4 invView;
     vec4 lightColor; //w ambient strength
-    PointLight pointLights[10];
-    int numLights;
+    vec4 clusterParams; // screen size, depth slice scale and bias
+    uvec4 clusterGrid; // clusters along xyz, light count
 } ubo;
 
+// filled by cluster_lights.comp, see LightClusterSystem
+layout(std430, set = 0, binding = 1) readonly buffer Lights {
+    PointLight lights[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Clusters {
+    uvec2 clusters[]; // offset into lightIndices and light count
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer LightIndices {
+    uint lightIndexCount;
+    uint lightIndices[];
+};
+
+#ifdef BINDLESS
+// Device::MAX_BINDLESS_TEXTURES
+layout (set = 2, binding = 0) uniform sampler2D textures[1024];
+#else
 layout (set = 1, binding = 1) uniform sampler2D diffuseMap;
-//layout (set = 1, binding = 2) uniform sampler2D specMap;
+layout (set = 1, binding = 3) uniform sampler2D specMap;
+#endif
 
 vec3 lightDirection = {5.0f, -5.0f, -5.0f};
 float specIntensity = 0.3f;
 float diffIntensity = 0.5f;
 float materialShininess = 32.0f;
 
-vec3 CalculateDirectional(vec3 texture, vec3 normal, vec3 viewDir)
+vec3 CalculateDirectional(vec3 texture, float specStrength, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(lightDirection);
     vec3 lightColor = ubo.lightColor.xyz;
@@ -51,12 +73,12 @@ vec3 CalculateDirectional(vec3 texture, vec3 normal, vec3 viewDir)
     //specular
     vec3 reflectDir = reflect(lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), materialShininess);
-    vec3 specular = specIntensity * spec * lightColor;
+    vec3 specular = specStrength * spec * lightColor;
 
     return (ambient + diffuse + specular) * texture;
 }
 
-vec3 CalculatePointLight(PointLight light, vec3 texture, vec3 normal, vec3 viewDir)
+vec3 CalculatePointLight(PointLight light, vec3 texture, float specStrength, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = (light.position.xyz - fragPosWorld);
     vec3 lightColor = light.color.xyz;
@@ -76,7 +98,7 @@ vec3 CalculatePointLight(PointLight light, vec3 texture, vec3 normal, vec3 viewD
     //specular
     vec3 reflectDir = reflect(lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), materialShininess);
-    vec3 specular = specIntensity * spec * lightColor;
+    vec3 specular = specStrength * spec * lightColor;
 
     ambient  *= attenuation;
     diffuse  *= attenuation;
@@ -85,17 +107,48 @@ vec3 CalculatePointLight(PointLight light, vec3 texture, vec3 normal, vec3 viewD
     return (ambient + diffuse + specular) * texture;
 }
 
+uint clusterIndex()
+{
+    uvec3 grid = ubo.clusterGrid.xyz;
+    float viewZ = (ubo.view * vec4(fragPosWorld, 1.0)).z;
+    uint slice = uint(clamp(log(viewZ) * ubo.clusterParams.z + ubo.clusterParams.w, 0.0, float(grid.z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / ubo.clusterParams.xy * vec2(grid.xy)), grid.xy - 1);
+    return tile.x + grid.x * (tile.y + grid.y * slice);
+}
+
 void main() {
     
-    vec3 texture = texture(diffuseMap, fragUv).xyz;
+    vec3 albedo = fragColor;
+    float specular = specIntensity;
+    if (HAS_DIFFUSE_MAP) {
+#ifdef BINDLESS
+        // instances of one draw can use different textures
+        albedo = texture(textures[nonuniformEXT(fragTextureIndex)], fragUv).xyz;
+#else
+        albedo = texture(diffuseMap, fragUv).xyz;
+#endif
+    }
+#ifndef BINDLESS
+    if (HAS_SPECULAR_MAP) {
+        specular = texture(specMap, fragUv).r;
+    }
+#endif
     vec3 norm = normalize(fragNormalWorld);
     vec3 cameraPosWorld = ubo.view[3].xyz;
     vec3 viewDir = normalize(cameraPosWorld - fragPosWorld);
     
     vec3 result = vec3(0.0f);
-    result = CalculateDirectional(texture, norm, viewDir);
-    for (int i = 0; i < ubo.numLights; i++) {
-        result += CalculatePointLight(ubo.pointLights[i], texture, norm, viewDir);
+    result = CalculateDirectional(albedo, specular, norm, viewDir);
+    // only the lights binned into this fragment's cluster
+    uvec2 cluster = clusters[clusterIndex()];
+    for (uint i = 0; i < cluster.y; i++) {
+        PointLight light = lights[lightIndices[cluster.x + i]];
+        // same cutoff the binning used, so cluster borders do not show
+        vec3 toLight = light.position.xyz - fragPosWorld;
+        if (dot(toLight, toLight) > light.position.w * light.position.w) {
+            continue;
+        }
+        result += CalculatePointLight(light, albedo, specular, norm, viewDir);
         //result += CalcSpotLight(spotLight, norm, FragPos, viewDir);  
     }
     outColor = vec4(result, 1.0);
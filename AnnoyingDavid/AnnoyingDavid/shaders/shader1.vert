@@ -1,45 +1,82 @@
 #version 450
 
+#ifdef PACKED_VERTICES
+// Model::PackedVertex, unorm position inside the mesh bounds and an octahedral normal
+layout(location = 0) in vec4 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec2 inNormal;
+
+layout(push_constant) uniform Push {
+    vec4 positionOffset;
+    vec4 positionScale;
+} push;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNormal;
+#endif
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
 layout(location = 3) out vec2 fragUv;
-
-layout(push_constant) uniform Push {
-    mat4 modelMatrix;
-    mat4 normalMatrix;
-} push;
-
-struct PointLight {
-    vec4 position;
-    vec4 color;
-};
+layout(location = 4) flat out uint fragTextureIndex;
 
 layout(set = 0, binding = 0) uniform GlobalUbo {
     mat4 projection;
     mat4 view;
     mat4 invView;
     vec4 lightColor;
-    PointLight pointLights[10];
-    int numLights;
+    vec4 clusterParams;
+    uvec4 clusterGrid;
 } ubo;
 
-layout(set = 1, binding = 0) uniform GameObjectBufferData {
+struct GameObjectBufferData {
     mat4 modelMatrix;
     mat4 normalMatrix;
-} gameObject;
+};
+
+// indexed by game object id
+layout(std430, set = 1, binding = 0) readonly buffer GameObjects {
+    GameObjectBufferData objects[];
+};
+
+struct InstanceData {
+    uint objectId;
+    uint textureIndex;
+};
+
+// one entry per instance, gl_InstanceIndex already includes firstInstance
+layout(std430, set = 1, binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
 
 void main() {
-    vec4 positionWorld = gameObject.modelMatrix * vec4(inPosition, 1.0);
+    InstanceData instance = instances[gl_InstanceIndex];
+    GameObjectBufferData gameObject = objects[instance.objectId];
+#ifdef PACKED_VERTICES
+    vec3 position = push.positionOffset.xyz + inPosition.xyz * push.positionScale.xyz;
+    vec3 normal = octDecode(inNormal);
+    vec3 color = vec3(1.0);
+#else
+    vec3 position = inPosition;
+    vec3 normal = inNormal;
+    vec3 color = inColor;
+#endif
+    vec4 positionWorld = gameObject.modelMatrix * vec4(position, 1.0);
     gl_Position = ubo.projection * ubo.view * positionWorld;
     
-    fragNormalWorld = normalize(mat3(gameObject.normalMatrix) * inNormal);
+    fragNormalWorld = normalize(mat3(gameObject.normalMatrix) * normal);
     fragPosWorld = positionWorld.xyz;
-    fragColor = inColor;
+    fragColor = color;
     fragUv = inTexCoord;
+    fragTextureIndex = instance.textureIndex;
 }
\ No newline at end of file